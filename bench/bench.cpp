@@ -0,0 +1,72 @@
+// Benchmarks of exectime's own hot paths, run with `make bench`
+
+#include "bench.hpp"
+#include "console.hpp"
+#include "process.hpp"
+#include "statistics.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <random>
+#include <functional>
+
+#ifndef BENCH_NULL_PROGRAM
+#define BENCH_NULL_PROGRAM "/bin/true"
+#endif
+
+// Fail loudly instead of timing a command that could not be executed
+static void check(const process::exec_result_t &result) {
+    if (result.exit_code != 0)
+        throw std::runtime_error(std::string(BENCH_NULL_PROGRAM) + " failed with " + process::classify(result) + ": " + result.stderr);
+}
+
+// Full launch of a program doing nothing: pipes, fork, exec, output drain and wait
+EXECTIME_BENCHMARK(process_run) {
+    const process::command_t command({BENCH_NULL_PROGRAM});
+    while (state.keep_running()) {
+        process::exec_result_t result = process::run(command);
+        bench::do_not_optimize(result);
+        check(result);
+    }
+}
+
+// Launch of a program writing the given number of bytes to stdout, drained
+// by the poll loop of process::child::wait() like every measured command
+EXECTIME_BENCHMARK_ARGS(process_output, 1ull << 10, 1ull << 16, 1ull << 20, 1ull << 26, 1ull << 30) {
+    const process::command_t command({BENCH_NULL_PROGRAM, std::to_string(state.argument())});
+    while (state.keep_running()) {
+        process::exec_result_t result = process::run(command);
+        bench::do_not_optimize(result);
+        check(result);
+        if (result.stdout.length() != state.argument())
+            throw std::runtime_error("Drained " + std::to_string(result.stdout.length()) + " of " + std::to_string(state.argument()) + " bytes");
+    }
+}
+
+// Summary statistics of the given number of samples
+EXECTIME_BENCHMARK_ARGS(statistics_calculate, 1000, 100000, 10000000, 100000000) {
+    std::mt19937_64 generator {42};
+    std::lognormal_distribution<double> distribution {7.0, 0.5};
+    std::vector<unsigned long> samples(state.argument());
+    for (auto &sample: samples)
+        sample = static_cast<unsigned long>(distribution(generator));
+
+    std::function<unsigned long (const unsigned long &)> selector = [] (const unsigned long &value) { return value; };
+    while (state.keep_running()) {
+        statistics::statistics_t<unsigned long> s = statistics::calculate(samples, selector);
+        bench::do_not_optimize(s);
+    }
+}
+
+// Argument parsing of a typical command line
+EXECTIME_BENCHMARK(console_parse_args) {
+    const char *argv[] = {"exectime", "--color", "--graph", "-i", "1000", "--input=data.csv", "--ref-stdout=expected.txt", "/usr/bin/sort", "-n", "-k2", "--parallel=4"};
+    const int argc = sizeof(argv) / sizeof(argv[0]);
+    while (state.keep_running()) {
+        std::vector<console::arg_t> args = console::parse_args(argc, argv);
+        bench::do_not_optimize(args);
+    }
+}
+
+EXECTIME_BENCHMARK_MAIN()
@@ -0,0 +1,23 @@
+// Does nothing, used to measure the cost of launching a process. Given a
+// byte count it writes that much to stdout, to measure draining output.
+
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h> // write()
+
+int main(int argc, char *argv[]) {
+    if (argc < 2)
+        return 0;
+
+    static char chunk[65536];
+    std::memset(chunk, 'x', sizeof(chunk));
+    unsigned long long remaining = std::strtoull(argv[1], nullptr, 10);
+    while (remaining > 0) {
+        ssize_t count = write(STDOUT_FILENO, chunk, remaining < sizeof(chunk) ? remaining : sizeof(chunk));
+        if (count <= 0)
+            return 1;
+        remaining -= count;
+    }
+    return 0;
+}
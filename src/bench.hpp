@@ -0,0 +1,324 @@
+#ifndef __BENCH_HPP_INCLUDED__
+#define __BENCH_HPP_INCLUDED__
+
+// In-process micro-benchmarks sharing the statistics and summary of the
+// command line tool:
+//
+//     #include "bench.hpp"
+//
+//     EXECTIME_BENCHMARK(string_append) {
+//         while (state.keep_running()) {
+//             std::string s {"foo"};
+//             s += "bar";
+//             bench::do_not_optimize(s);
+//         }
+//     }
+//
+//     EXECTIME_BENCHMARK_MAIN()
+//
+// Only the loop driven by keep_running() is timed; setup placed before it
+// is excluded. EXECTIME_BENCHMARK_ARGS registers one run per argument.
+
+#include "console.hpp"
+#include "statistics.hpp"
+#include "report.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h> // __rdtsc()
+#define BENCH_HAVE_TSC
+#endif
+
+namespace bench {
+    // Force the compiler to materialize value, as if it was read by unknown code
+    template<typename T>
+    inline void do_not_optimize(const T &value) {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    template<typename T>
+    inline void do_not_optimize(T &value) {
+        asm volatile("" : "+r,m"(value) : : "memory");
+    }
+
+    // Force all pending memory writes to be considered observable
+    inline void clobber_memory() {
+        asm volatile("" : : : "memory");
+    }
+
+    namespace tsc {
+        // Raw timestamp: the time stamp counter where available, nanoseconds otherwise
+        inline std::uint64_t now() {
+#ifdef BENCH_HAVE_TSC
+            _mm_lfence();
+            std::uint64_t ticks = __rdtsc();
+            _mm_lfence();
+            return ticks;
+#else
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+        }
+
+        inline double calibrate(const std::chrono::milliseconds duration = std::chrono::milliseconds(50)) {
+#ifdef BENCH_HAVE_TSC
+            auto begin = std::chrono::steady_clock::now();
+            std::uint64_t first = now();
+            while (std::chrono::steady_clock::now() - begin < duration);
+            std::uint64_t last = now();
+            auto end = std::chrono::steady_clock::now();
+            return (last - first) / static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+#else
+            (void)duration;
+            return 1.0;
+#endif
+        }
+
+        // Ticks per nanosecond, measured once against the steady clock
+        inline double ticks_per_ns() {
+            static const double ratio = calibrate();
+            return ratio;
+        }
+    }
+
+    // Handed to each benchmark call. Only the loop driven by keep_running()
+    // is timed, so setup before and teardown after it are excluded.
+    class state {
+        private:
+            std::uint64_t remaining;
+            std::uint64_t batch;
+            std::uint64_t value;
+        public:
+            std::uint64_t begin {0};
+            std::uint64_t end {0};
+
+            explicit state(const std::uint64_t batch_size, const std::uint64_t argument = 0) : remaining(batch_size), batch(batch_size), value(argument) {
+            }
+
+            inline bool keep_running() {
+                if (remaining == 0) {
+                    end = tsc::now();
+                    return false;
+                }
+                if (remaining-- == batch)
+                    begin = tsc::now();
+                return true;
+            }
+
+            std::uint64_t batch_size() const {
+                return batch;
+            }
+
+            // Parameter of a benchmark registered with EXECTIME_BENCHMARK_ARGS
+            std::uint64_t argument() const {
+                return value;
+            }
+    };
+
+    struct benchmark_t {
+        std::string name;
+        void (*function)(state &);
+        std::uint64_t argument {0};
+    };
+
+    inline std::vector<benchmark_t> &registry() {
+        static std::vector<benchmark_t> benchmarks;
+        return benchmarks;
+    }
+
+    struct registrar {
+        registrar(const char *name, void (*function)(state &)) {
+            registry().push_back(benchmark_t {name, function, 0});
+        }
+
+        // One benchmark per argument, named <name>/<argument>
+        registrar(const char *name, void (*function)(state &), const std::vector<std::uint64_t> &arguments) {
+            for (const auto &argument: arguments)
+                registry().push_back(benchmark_t {std::string(name) + "/" + std::to_string(argument), function, argument});
+        }
+    };
+
+    struct options_t {
+        unsigned int samples {100};
+        unsigned int min_samples {3};
+        std::chrono::nanoseconds min_batch_time {std::chrono::milliseconds(1)};
+        std::chrono::nanoseconds max_time {std::chrono::seconds(5)};
+        std::string filter {""};
+    };
+
+    // Ticks consumed by the timed loop of one call with the given batch size
+    inline std::uint64_t measure(const benchmark_t &benchmark, const std::uint64_t batch_size) {
+        state s(batch_size, benchmark.argument);
+        std::uint64_t begin = tsc::now();
+        benchmark.function(s);
+        std::uint64_t end = tsc::now();
+        if (s.end == 0)
+            return end - begin; // Loop not used or left early, time the whole call
+        return s.end - s.begin;
+    }
+
+    // Grow the batch until one call takes at least min_batch_time, so that
+    // timer resolution and overhead become negligible per operation
+    inline std::uint64_t calibrate_batch(const benchmark_t &benchmark, const options_t &options) {
+        const double target = options.min_batch_time.count() * tsc::ticks_per_ns();
+        std::uint64_t batch_size = 1;
+        while (batch_size < (1ull << 40)) {
+            double ticks = measure(benchmark, batch_size);
+            if (ticks >= target)
+                break;
+            double factor = (ticks > 0.0) ? std::min(10.0, std::max(2.0, 1.2 * target / ticks)) : 10.0;
+            batch_size = static_cast<std::uint64_t>(batch_size * factor);
+        }
+        return batch_size;
+    }
+
+    // Run a single benchmark and print its summary. Values are nanoseconds per operation.
+    inline std::vector<double> run(std::ostream &stream, const benchmark_t &benchmark, const options_t &options) {
+        const std::uint64_t batch_size = calibrate_batch(benchmark, options);
+        const double ticks_per_ns = tsc::ticks_per_ns();
+
+        // Stop early once the time budget is spent, given the minimum sample count
+        std::vector<double> values;
+        values.reserve(options.samples);
+        auto started = std::chrono::steady_clock::now();
+        for (unsigned int sample = 0; sample < options.samples; sample++) {
+            if (sample >= options.min_samples && std::chrono::steady_clock::now() - started >= options.max_time)
+                break;
+            values.push_back(measure(benchmark, batch_size) / ticks_per_ns / batch_size);
+        }
+
+        // Display in the largest unit keeping the fastest sample above one
+        double scale = 1.0;
+        std::string unit = "ns";
+        double fastest = *std::min_element(values.begin(), values.end());
+        for (const auto &candidate: {std::make_pair(1e3, "us"), std::make_pair(1e6, "ms"), std::make_pair(1e9, "s")}) {
+            if (fastest < candidate.first)
+                break;
+            scale = candidate.first;
+            unit = candidate.second;
+        }
+
+        const std::string prefix = benchmark.name + ": ";
+        stream << prefix << "batch size........................" << batch_size << " (" << values.size() << " samples)" << std::endl;
+        report::summary(stream, prefix, values, scale, unit);
+        return values;
+    }
+
+    // Strictly parse a non-negative integer, rejecting trailing garbage and signs
+    inline unsigned long parse_count(const std::string &text) {
+        std::size_t used = 0;
+        if (text.length() == 0 || text[0] == '-' || text[0] == '+')
+            throw std::invalid_argument("Not a count: " + text);
+        unsigned long value = std::stoul(text, &used);
+        if (used != text.length())
+            throw std::invalid_argument("Not a count: " + text);
+        return value;
+    }
+
+    inline int main(const int argc, const char *argv[]) {
+        // Messages carry the name of the benchmark binary, not of exectime
+        std::string program = argv[0];
+        program = program.substr(program.find_last_of('/') + 1);
+
+        options_t options;
+        bool skip_next_arg {false};
+        for (const auto &arg: console::parse_args(argc, argv)) {
+            if (skip_next_arg) {
+                skip_next_arg = false;
+                continue;
+            }
+
+            if (arg.key == "--help") {
+                std::cout << "usage: " << argv[0] << " [--color] [--filter=<name>] [--max-time=<ms>] [--min-time=<ms>] [-i <x>]" << std::endl;
+                std::cout << std::endl;
+                std::cout << "Run the registered benchmarks." << std::endl;
+                std::cout << std::endl;
+                std::cout << "  --color               Colorized output for easier interpretation." << std::endl;
+                std::cout << "  --filter=<name>       Only run benchmarks whose name contains the given string." << std::endl;
+                std::cout << "  --help                Print this help and exit." << std::endl;
+                std::cout << "  -i <x>                Number of samples per benchmark. Default is 100." << std::endl;
+                std::cout << "  --max-time=<ms>       Time budget per benchmark, at least 3 samples are taken. Default is 5000." << std::endl;
+                std::cout << "  --min-time=<ms>       Minimum time per sample, batch size is calibrated to it. Default is 1." << std::endl;
+                return 0;
+            }
+            else if (arg.key == "--color") {
+                console::color::enable = true;
+            }
+            else if (arg.key == "--filter") {
+                options.filter = arg.value;
+            }
+            else if (arg.key == "--max-time" || arg.key == "--min-time") {
+                try {
+                    std::chrono::milliseconds milliseconds(parse_count(arg.value));
+                    if (milliseconds.count() < 0 || milliseconds > std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::nanoseconds::max()))
+                        throw std::out_of_range(arg.value);
+                    (arg.key == "--max-time" ? options.max_time : options.min_batch_time) = milliseconds;
+                }
+                catch (const std::exception &) {
+                    std::cerr << console::color::red << program << ": Invalid " << arg.key << " argument, ignoring: " << arg.value << console::color::reset << std::endl;
+                }
+            }
+            else if (arg.key == "-i" && arg.next) {
+                try {
+                    unsigned long temp = parse_count(arg.next->key);
+                    if (temp < 1 || temp > std::numeric_limits<unsigned int>::max())
+                        throw std::out_of_range(arg.next->key);
+                    options.samples = static_cast<unsigned int>(temp);
+                }
+                catch (const std::exception &) {
+                    std::cerr << console::color::red << program << ": Invalid sample argument, ignoring: " << arg.next->key << console::color::reset << std::endl;
+                }
+                skip_next_arg = true;
+            }
+            else {
+                std::cerr << console::color::red << program << ": Unhandled argument: \"" << arg.key << "\"" << console::color::reset << std::endl;
+            }
+        }
+
+#ifdef BENCH_HAVE_TSC
+        std::cout << program << ": timer.............................tsc (" << tsc::ticks_per_ns() << " ticks/ns)" << std::endl;
+#else
+        std::cout << program << ": timer.............................steady_clock" << std::endl;
+#endif
+        int status {0};
+        for (const auto &benchmark: registry()) {
+            if (benchmark.name.find(options.filter) == std::string::npos)
+                continue;
+            try {
+                run(std::cout, benchmark, options);
+            }
+            catch (const std::exception &e) {
+                std::cerr << console::color::red << program << ": " << benchmark.name << ": " << e.what() << console::color::reset << std::endl;
+                status = 1;
+            }
+        }
+        return status;
+    }
+}
+
+// Define and register a benchmark function taking `bench::state &state`
+#define EXECTIME_BENCHMARK(name) \
+    static void name(bench::state &); \
+    static bench::registrar name##_registrar {#name, name}; \
+    static void name(bench::state &state)
+
+// Define and register a benchmark once per argument, see state::argument()
+#define EXECTIME_BENCHMARK_ARGS(name, ...) \
+    static void name(bench::state &); \
+    static bench::registrar name##_registrar {#name, name, {__VA_ARGS__}}; \
+    static void name(bench::state &state)
+
+#define EXECTIME_BENCHMARK_MAIN() \
+    int main(int argc, const char *argv[]) { \
+        console::color::enable = false; \
+        return bench::main(argc, argv); \
+    }
+
+#endif //__BENCH_HPP_INCLUDED__
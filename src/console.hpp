@@ -6,8 +6,12 @@
 #include <stdexcept>
 #include <iostream>
 #include <vector>
+#include <algorithm>
 
 #include <stdio.h>
+#include <errno.h>
+#include <unistd.h> // write(), STDERR_FILENO
+#include <sys/ioctl.h> // ioctl(), TIOCGWINSZ
 
 // Reference: https://en.wikipedia.org/wiki/ANSI_escape_code#Colors
 #define ANSI_COLOR_FOREGROUND_RESET            "\x1b[0;0m"
@@ -45,7 +49,7 @@ namespace console {
         std::string stdout;
     };
 
-    exec_result_t exec(const std::string &command) {
+    inline exec_result_t exec(const std::string &command) {
         FILE* fp = popen(command.c_str(), "r");
         if (fp == nullptr)
             throw std::runtime_error("Failed to open pipe: \"" + command + "\"");
@@ -223,26 +227,39 @@ namespace console {
         arg_t *next;
     };
 
-    unsigned int text_width(const std::string &str) {
+    // Bytes of the glyph starting at offset. A byte that does not start a
+    // complete UTF-8 sequence counts as a glyph of its own, so that arbitrary
+    // bytes, as in command arguments, can still be laid out.
+    inline unsigned int utf8_sequence_length(const std::string &str, const std::string::size_type offset) {
+        const unsigned char c = str[offset];
+        unsigned int length = 1;
+        if ((c & 0xE0) == 0xC0)
+            length = 2;
+        else if ((c & 0xF0) == 0xE0)
+            length = 3;
+        else if ((c & 0xF8) == 0xF0)
+            length = 4;
+        else if ((c & 0xFC) == 0xF8)
+            length = 5;
+        else if ((c & 0xFE) == 0xFC)
+            length = 6;
+        if (offset + length > str.length())
+            return 1;
+        for (unsigned int i = 1; i < length; i++) {
+            if ((static_cast<unsigned char>(str[offset + i]) & 0xC0) != 0x80)
+                return 1;
+        }
+        return length;
+    }
+
+    inline unsigned int text_width(const std::string &str) {
         unsigned int length = 0;
         for (unsigned int i = 0; i < str.length(); i++) {
             unsigned char c = str[i];
 
             // UTF-8 multibyte
-            if (c > 127) {
-                if ((c & 0xE0) == 0xC0)
-                    i += 1; // 2 byte sequence
-                else if ((c & 0xF0) == 0xE0)
-                    i += 2; // 3 byte sequence
-                else if ((c & 0xF8) == 0xF0)
-                    i += 3; // 4 byte sequence
-                else if ((c & 0xFC) == 0xF8)
-                    i += 4; // 5 byte sequence
-                else if ((c & 0xFE) == 0xFC)
-                    i += 5; // 6 byte sequence
-                else
-                    throw std::runtime_error("Not valid UTF-8 (offset " + std::to_string(i) + "), probably ISO-8859-1: \"" + str + "\"");
-            }
+            if (c > 127)
+                i += utf8_sequence_length(str, i) - 1;
 
             // ANSI escape: \x1b[...m
             if (c == 27) {
@@ -250,7 +267,8 @@ namespace console {
                     std::string::size_type offset_m = str.find("m", i + 2);
                     if(offset_m == std::string::npos)
                         throw std::runtime_error("Could not find ANSI escape sequence (offset " + std::to_string(i) + ") end symbol: \"" + str + "\"");
-                    i = offset_m + 1;
+                    i = offset_m;
+                    continue;
                 }
             }
 
@@ -259,7 +277,7 @@ namespace console {
         return length;
     }
 
-    const std::vector<arg_t> parse_args(const int argc, const char *argv[]) {
+    inline const std::vector<arg_t> parse_args(const int argc, const char *argv[]) {
         std::vector<arg_t> args;
 
         for (int i = 1; i < argc; i++) {
@@ -310,48 +328,130 @@ namespace console {
 
     class tty {
         private:
-            void write_char(int x, int y, char c, bool sync) {
+            int fd {STDERR_FILENO};
+            std::vector<std::vector<std::string>> buffer;
+            std::vector<bool> dirty;
+            int used_rows {0};
+            int drawn_rows {0};
+
+            void write_char(int x, int y, const std::string &glyph, bool sync) {
                 if (x < 0 || x >= cols)
                     throw std::out_of_range("X coordinate (" + std::to_string(x) + ") is out of range (0-" + std::to_string(cols) + ").");
                 if (y < 0 || y >= rows)
                     throw std::out_of_range("Y coordinate (" + std::to_string(y) + ") is out of range (0-" + std::to_string(rows) + ").");
 
-                // TODO: implement
-                (void)c;
-                (void)sync;
-                throw std::runtime_error("write_char() is not yet implemented.");
+                if (buffer[y][x] != glyph) {
+                    buffer[y][x] = glyph;
+                    dirty[y] = true;
+                }
+                used_rows = std::max(used_rows, y + 1);
 
-                //if (sync)
-                //    redraw();
+                if (sync)
+                    redraw();
+            }
+
+            void flush(const std::string &frame) {
+                std::string::size_type offset = 0;
+                while (offset < frame.length()) {
+                    ssize_t written = ::write(fd, frame.data() + offset, frame.length() - offset);
+                    if (written < 0) {
+                        if (errno == EINTR)
+                            continue;
+                        throw std::runtime_error("write() tty: " + std::to_string(errno));
+                    }
+                    offset += written;
+                }
             }
         public:
             int cols {0};
             int rows {0};
 
-            tty() {
-                std::string stty = exec("stty -F /dev/tty size").stdout;
-                if (stty.length() > 0) {
-                    std::istringstream st(stty);
-                    st >> rows;
-                    st >> cols;
+            tty(const int output_fd = STDERR_FILENO) : fd(output_fd) {
+                struct winsize size;
+                if (ioctl(fd, TIOCGWINSZ, &size) == 0 && size.ws_col > 0 && size.ws_row > 0) {
+                    rows = size.ws_row;
+                    cols = size.ws_col;
                 }
                 else {
-                    rows = 50;
-                    cols = 100;
+                    std::string stty = exec("stty -F /dev/tty size 2>/dev/null").stdout;
+                    if (stty.length() > 0) {
+                        std::istringstream st(stty);
+                        st >> rows;
+                        st >> cols;
+                    }
+                    if (rows <= 0 || cols <= 0) {
+                        rows = 50;
+                        cols = 100;
+                    }
                 }
+                buffer.assign(rows, std::vector<std::string>(cols, " "));
+                dirty.assign(rows, false);
             }
 
             ~tty() {
             }
 
             void write(int x, int y, char c) {
-                write_char(x, y, c, true);
+                write_char(x, y, std::string(1, c), true);
             }
 
             void write(int x, int y, std::string s) {
-                for (unsigned int i = 0; i < s.length(); i++)
-                    write_char(x + i, y, s[i], false);
-                //redraw();
+                for (unsigned int i = 0; i < s.length(); x++) {
+                    unsigned int length = utf8_sequence_length(s, i);
+                    write_char(x, y, s.substr(i, length), false);
+                    i += length;
+                }
+                redraw();
+            }
+
+            // Write a full row, padding the remainder with blanks. Text beyond the width is cut.
+            void write_line(int y, const std::string &s) {
+                int x = 0;
+                for (unsigned int i = 0; i < s.length() && x < cols; x++) {
+                    unsigned int length = utf8_sequence_length(s, i);
+                    write_char(x, y, s.substr(i, length), false);
+                    i += length;
+                }
+                for (; x < cols; x++)
+                    write_char(x, y, " ", false);
+            }
+
+            // Emit all changed rows in a single write(), leaving the cursor below the drawn area.
+            void redraw() {
+                if (used_rows == drawn_rows && std::find(dirty.begin(), dirty.begin() + used_rows, true) == dirty.begin() + used_rows)
+                    return;
+
+                std::string frame;
+                if (drawn_rows > 0)
+                    frame += "\r\x1b[" + std::to_string(drawn_rows) + "A";
+                for (int y = 0; y < used_rows; y++) {
+                    if (dirty[y] || y >= drawn_rows) {
+                        std::string::size_type end = 0;
+                        std::string line;
+                        for (const auto &glyph: buffer[y]) {
+                            line += glyph;
+                            if (glyph != " ")
+                                end = line.length();
+                        }
+                        frame += "\r\x1b[2K" + line.substr(0, end);
+                        dirty[y] = false;
+                    }
+                    frame += "\n";
+                }
+                drawn_rows = used_rows;
+                flush(frame);
+            }
+
+            // Erase the drawn area and return the cursor to where drawing started.
+            void clear() {
+                if (drawn_rows > 0)
+                    flush("\r\x1b[" + std::to_string(drawn_rows) + "A\x1b[J");
+                for (int y = 0; y < used_rows; y++) {
+                    std::fill(buffer[y].begin(), buffer[y].end(), " ");
+                    dirty[y] = false;
+                }
+                used_rows = 0;
+                drawn_rows = 0;
             }
     };
 }
@@ -0,0 +1,358 @@
+#ifndef __GRAPH_HPP_INCLUDED__
+#define __GRAPH_HPP_INCLUDED__
+
+#include "console.hpp"
+#include "statistics.hpp"
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+namespace graph {
+    struct series_t {
+        std::string label;
+        std::vector<double> values;
+    };
+
+    using color_t = const std::string (*)();
+
+    // Series colors, cycled when more series than colors are given
+    static const color_t palette[] = {
+        console::color::cyan,
+        console::color::magenta,
+        console::color::yellow,
+        console::color::green,
+        console::color::blue,
+        console::color::red
+    };
+
+    // Eighth blocks, horizontal and vertical
+    static const char *blocks_horizontal[] = {"", "▏", "▎", "▍", "▌", "▋", "▊", "▉", "█"};
+    static const char *blocks_vertical[] = {" ", "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█"};
+
+    inline color_t series_color(const std::size_t index) {
+        return palette[index % (sizeof(palette) / sizeof(palette[0]))];
+    }
+
+    inline std::string pad_left(const std::string &str, const unsigned int width) {
+        unsigned int length = console::text_width(str);
+        if (length >= width)
+            return str;
+        return std::string(width - length, ' ') + str;
+    }
+
+    inline std::string pad_right(const std::string &str, const unsigned int width) {
+        unsigned int length = console::text_width(str);
+        if (length >= width)
+            return str;
+        return str + std::string(width - length, ' ');
+    }
+
+    // Cut a plain UTF-8 string to at most the given number of glyphs, invalid bytes count as one each
+    inline std::string truncate(const std::string &str, const unsigned int width) {
+        unsigned int glyphs = 0;
+        for (std::string::size_type i = 0; i < str.length(); glyphs++) {
+            if (glyphs == width)
+                return str.substr(0, i);
+            i += console::utf8_sequence_length(str, i);
+        }
+        return str;
+    }
+
+    inline std::string format_value(const double value, const std::string &unit) {
+        std::ostringstream ss;
+        ss.precision(4);
+        ss << value << unit;
+        return ss.str();
+    }
+
+    struct range_t {
+        double lower {0.0};
+        double upper {0.0};
+
+        double span() const {
+            return upper - lower;
+        }
+
+        // Map a value onto [0, cells), clamped
+        unsigned int cell(const double value, const unsigned int cells) const {
+            if (span() <= 0.0 || cells == 0)
+                return 0;
+            double position = (value - lower) / span() * cells;
+            return std::min(cells - 1, static_cast<unsigned int>(std::max(0.0, position)));
+        }
+
+        double at(const double cell, const unsigned int cells) const {
+            return lower + span() * cell / cells;
+        }
+    };
+
+    inline range_t common_range(const std::vector<series_t> &series) {
+        range_t range;
+        bool first {true};
+        for (const auto &s: series) {
+            if (s.values.size() == 0)
+                continue;
+            auto bounds = std::minmax_element(s.values.begin(), s.values.end());
+            if (first || *bounds.first < range.lower)
+                range.lower = *bounds.first;
+            if (first || *bounds.second > range.upper)
+                range.upper = *bounds.second;
+            first = false;
+        }
+        return range;
+    }
+
+    // Number of histogram bins: the larger of Sturges' and Freedman-Diaconis' rule, capped
+    inline unsigned int bin_count(const std::vector<double> &values, const range_t &range, const unsigned int max_bins) {
+        if (values.size() < 2 || range.span() <= 0.0)
+            return 1;
+
+        unsigned int sturges = static_cast<unsigned int>(std::ceil(std::log2(values.size()))) + 1;
+        double iqr = statistics::percentile(values, 75.0) - statistics::percentile(values, 25.0);
+        unsigned int freedman_diaconis = 0;
+        if (iqr > 0.0) {
+            double width = 2.0 * iqr / std::cbrt(values.size());
+            freedman_diaconis = static_cast<unsigned int>(std::min<double>(max_bins, std::ceil(range.span() / width)));
+        }
+        return std::max(1u, std::min(max_bins, std::max(sturges, freedman_diaconis)));
+    }
+
+    // Gaussian kernel density estimate sampled at the center of each column.
+    // Values are pre-binned on a fine grid so the cost is O(n + columns * grid).
+    inline std::vector<double> density(const std::vector<double> &values, const range_t &range, const unsigned int columns) {
+        std::vector<double> result(columns, 0.0);
+        if (values.size() == 0 || columns == 0)
+            return result;
+
+        if (range.span() <= 0.0) {
+            std::fill(result.begin(), result.end(), 1.0);
+            return result;
+        }
+
+        statistics::statistics_t<double> s = statistics::calculate(values, std::function<double (const double &)>([] (const double &value) { return value; }));
+        double iqr = statistics::percentile(values, 75.0) - statistics::percentile(values, 25.0);
+        double spread = s.standard_deviation;
+        if (iqr > 0.0)
+            spread = std::min(spread, iqr / 1.34);
+        double bandwidth = 0.9 * spread * std::pow(s.sample_size, -0.2); // Silverman's rule of thumb
+        if (bandwidth <= 0.0)
+            bandwidth = range.span() / columns;
+
+        const unsigned int grid_size = columns * 4;
+        std::vector<unsigned int> grid(grid_size, 0);
+        for (const double &value: values)
+            grid[range.cell(value, grid_size)]++;
+
+        for (unsigned int column = 0; column < columns; column++) {
+            double x = range.at(column + 0.5, columns);
+            for (unsigned int g = 0; g < grid_size; g++) {
+                if (grid[g] == 0)
+                    continue;
+                double u = (x - range.at(g + 0.5, grid_size)) / bandwidth;
+                result[column] += grid[g] * std::exp(-0.5 * u * u);
+            }
+            result[column] /= values.size() * bandwidth * std::sqrt(2.0 * M_PI);
+        }
+        return result;
+    }
+
+    // Horizontal bar histogram with one row per bin (and series, if overlaid)
+    inline std::vector<std::string> histogram(const std::vector<series_t> &series, const unsigned int width, const std::string &unit, const unsigned int max_bins = 20) {
+        std::vector<std::string> lines;
+        range_t range = common_range(series);
+
+        unsigned int bins = 1;
+        for (const auto &s: series)
+            bins = std::max(bins, bin_count(s.values, range, max_bins));
+
+        std::vector<std::vector<unsigned int>> counts;
+        unsigned int highest = 0;
+        for (const auto &s: series) {
+            counts.emplace_back(bins, 0);
+            for (const double &value: s.values)
+                counts.back()[range.cell(value, bins)]++;
+            highest = std::max(highest, *std::max_element(counts.back().begin(), counts.back().end()));
+        }
+        if (highest == 0)
+            return lines;
+
+        std::vector<std::string> labels;
+        unsigned int label_width = 0;
+        for (unsigned int bin = 0; bin < bins; bin++) {
+            labels.push_back(format_value(range.at(bin, bins), unit));
+            label_width = std::max(label_width, console::text_width(labels.back()));
+        }
+
+        const unsigned int count_width = std::to_string(highest).length() + 1;
+        const int bar_width = static_cast<int>(width) - label_width - count_width - 3;
+        if (bar_width <= 0)
+            return lines;
+
+        for (unsigned int bin = 0; bin < bins; bin++) {
+            for (std::size_t index = 0; index < series.size(); index++) {
+                unsigned int count = counts[index][bin];
+                unsigned int eighths = static_cast<unsigned int>(std::round(8.0 * bar_width * count / highest));
+
+                std::string bar;
+                for (unsigned int full = 0; full < eighths / 8; full++)
+                    bar += blocks_horizontal[8];
+                bar += blocks_horizontal[eighths % 8];
+
+                std::string label = (index == 0) ? labels[bin] : "";
+                lines.push_back(pad_left(label, label_width) + " │" + series_color(index)() + pad_right(bar, bar_width) + console::color::reset() + " " + pad_left(std::to_string(count), count_width));
+            }
+        }
+        return lines;
+    }
+
+    // Kernel density curves drawn on a shared axis. A single series is drawn
+    // filled, multiple series as colored outlines where overlaps are marked.
+    inline std::vector<std::string> density_plot(const std::vector<series_t> &series, const unsigned int width, const unsigned int height = 8) {
+        std::vector<std::string> lines;
+        range_t range = common_range(series);
+        if (width == 0 || height == 0 || series.size() == 0)
+            return lines;
+
+        std::vector<std::vector<double>> curves;
+        double highest = 0.0;
+        for (const auto &s: series) {
+            curves.push_back(density(s.values, range, width));
+            highest = std::max(highest, *std::max_element(curves.back().begin(), curves.back().end()));
+        }
+        if (highest <= 0.0)
+            return lines;
+
+        // Cells: glyph and owning series (-1 for blank, -2 for overlap)
+        std::vector<std::vector<std::string>> glyphs(height, std::vector<std::string>(width, " "));
+        std::vector<std::vector<int>> owners(height, std::vector<int>(width, -1));
+        for (std::size_t index = 0; index < curves.size(); index++) {
+            for (unsigned int column = 0; column < width; column++) {
+                unsigned int level = static_cast<unsigned int>(std::round(curves[index][column] / highest * height * 8));
+                if (level == 0)
+                    continue;
+                unsigned int top = (level - 1) / 8;
+                unsigned int first = (series.size() == 1) ? 0 : top;
+                for (unsigned int row = first; row <= top; row++) {
+                    unsigned int y = height - 1 - row;
+                    std::string glyph = (row < top) ? blocks_vertical[8] : blocks_vertical[(level - 1) % 8 + 1];
+                    if (owners[y][column] >= 0 && owners[y][column] != static_cast<int>(index)) {
+                        glyphs[y][column] = "◆";
+                        owners[y][column] = -2;
+                    }
+                    else {
+                        glyphs[y][column] = glyph;
+                        owners[y][column] = index;
+                    }
+                }
+            }
+        }
+
+        for (unsigned int y = 0; y < height; y++) {
+            std::string line;
+            int current = -1;
+            for (unsigned int column = 0; column < width; column++) {
+                int owner = owners[y][column];
+                if (owner != current) {
+                    if (owner >= 0)
+                        line += series_color(owner)();
+                    else if (owner == -2)
+                        line += console::color::white();
+                    else
+                        line += console::color::reset();
+                    current = owner;
+                }
+                line += glyphs[y][column];
+            }
+            line += console::color::reset();
+            lines.push_back(line);
+        }
+        return lines;
+    }
+
+    // One box plot row per series: whiskers at min/max, box at Q1-Q3, median marker
+    inline std::vector<std::string> box_plot(const std::vector<series_t> &series, const unsigned int width) {
+        std::vector<std::string> lines;
+        range_t range = common_range(series);
+        for (std::size_t index = 0; index < series.size(); index++) {
+            const auto &values = series[index].values;
+            if (values.size() == 0 || width == 0) {
+                lines.push_back("");
+                continue;
+            }
+
+            unsigned int minimum = range.cell(*std::min_element(values.begin(), values.end()), width);
+            unsigned int maximum = range.cell(*std::max_element(values.begin(), values.end()), width);
+            unsigned int q1 = range.cell(statistics::percentile(values, 25.0), width);
+            unsigned int median = range.cell(statistics::percentile(values, 50.0), width);
+            unsigned int q3 = range.cell(statistics::percentile(values, 75.0), width);
+
+            std::string line;
+            for (unsigned int column = 0; column < width; column++) {
+                if (column == median)
+                    line += "┃";
+                else if (column >= q1 && column <= q3)
+                    line += "▒";
+                else if (column == minimum)
+                    line += "├";
+                else if (column == maximum)
+                    line += "┤";
+                else if (column > minimum && column < maximum)
+                    line += "─";
+                else
+                    line += " ";
+            }
+            lines.push_back(series_color(index)() + line + console::color::reset());
+        }
+        return lines;
+    }
+
+    // Histogram, density and box plot of all series, each line prefixed with the given string
+    inline void render(std::ostream &stream, const std::vector<series_t> &series, const unsigned int width, const std::string &prefix, const std::string &unit) {
+        if (series.size() == 0)
+            return;
+
+        range_t range = common_range(series);
+        std::vector<std::string> labels;
+        unsigned int label_width = 0;
+        for (const auto &s: series) {
+            labels.push_back((series.size() > 1) ? truncate(s.label, 16) : "");
+            label_width = std::max(label_width, console::text_width(labels.back()));
+        }
+        const std::string margin(label_width + 1, ' ');
+
+        int plot_width = static_cast<int>(width) - console::text_width(prefix) - margin.length() - 1;
+        if (plot_width < 10)
+            return;
+
+        if (series.size() > 1) {
+            stream << prefix << "legend:";
+            for (std::size_t index = 0; index < series.size(); index++)
+                stream << " " << series_color(index)() << "■ " << series[index].label << console::color::reset();
+            stream << std::endl;
+        }
+
+        stream << prefix << "histogram:" << std::endl;
+        for (const auto &line: histogram(series, plot_width + margin.length(), unit))
+            stream << prefix << line << std::endl;
+
+        stream << prefix << "density:" << std::endl;
+        for (const auto &line: density_plot(series, plot_width))
+            stream << prefix << margin << "│" << line << std::endl;
+        std::vector<std::string> boxes = box_plot(series, plot_width);
+        for (std::size_t index = 0; index < boxes.size(); index++)
+            stream << prefix << pad_right(labels[index], margin.length()) << "│" << boxes[index] << std::endl;
+
+        std::string lower = format_value(range.lower, unit);
+        std::string upper = format_value(range.upper, unit);
+        stream << prefix << margin << "└";
+        for (int column = 0; column < plot_width; column++)
+            stream << "─";
+        stream << std::endl;
+        stream << prefix << margin << " " << pad_right(lower, std::max(0, plot_width - static_cast<int>(console::text_width(upper)))) << upper << std::endl;
+    }
+}
+
+#endif //__GRAPH_HPP_INCLUDED__
@@ -1,7 +1,13 @@
 #include "exectime.hpp"
 #include "statistics.hpp"
+#include "report.hpp"
 #include "process.hpp"
 #include "console.hpp"
+#include "progress.hpp"
+#include "remote.hpp"
+#include "schedule.hpp"
+#include "graph.hpp"
+#include "profile.hpp"
 
 #include <stdexcept>
 #include <iostream>
@@ -11,19 +17,48 @@
 #include <future>
 #include <algorithm>
 #include <chrono>
+#include <memory>
+#include <thread>
+#include <random>
+#include <cmath>
+#include <limits>
+#include <map>
+
+#include <unistd.h> // isatty(), STDOUT_FILENO, STDERR_FILENO
+#include <signal.h> // signal(), SIGPIPE
 
 void print_usage() {
-    std::cout << "usage: " << PROGRAM_NAME << " [--color] [i <x>] <command>" << std::endl;
+    std::cout << "usage: " << PROGRAM_NAME << " [--color] [i <x>] <command> [::: <command>...]" << std::endl;
     std::cout << std::endl;
-    std::cout << "Execute a given command and measure the time consumed." << std::endl;
+    std::cout << "Execute a given command and measure the time consumed. Several commands separated" << std::endl;
+    std::cout << "by ::: are run interleaved, in a random order per iteration." << std::endl;
     std::cout << std::endl;
+    std::cout << "  --agent=<address>     Serve runs for a coordinator on unix:<path> or [<host>]:<port>. Executes any command requested." << std::endl;
+    std::cout << "                        An empty host listens on all interfaces. TCP addresses, loopback included, need --token-file." << std::endl;
     std::cout << "  --cmp-stdout          Enable stdout comparison per iteration. If stdout differ then fail execution." << std::endl;
     std::cout << "  --cmp-stderr          Enable stderr comparison per iteration. If stderr differ then fail execution." << std::endl;
     std::cout << "  --color               Colorized output for easier interpretation." << std::endl;
+    std::cout << "  --control=<command>   Run a control command every iteration and correct the others for drift. Split on whitespace." << std::endl;
+    std::cout << "  --env=<key>=<values>  Run every command once per comma separated value of the environment variable." << std::endl;
+    std::cout << "                        Repeat for further variables, all combinations are run interleaved." << std::endl;
+    std::cout << "  --graph               Render histogram, density and box plot of the execution times." << std::endl;
     std::cout << "  --help                Print this help and exit." << std::endl;
+    std::cout << "  --hosts=<addresses>   Comma separated agent addresses to distribute the iterations over." << std::endl;
+    std::cout << "  --input=<file>        Feed the file contents to stdin of each iteration." << std::endl;
     std::cout << "  -i <x>                Number of iterations to execute the command. Default is 1." << std::endl;
+    std::cout << "  --ok-exit=<codes>     Comma separated exit codes counted as successful. Default is 0." << std::endl;
+    std::cout << "  --prespawn            Fork the next iteration while the current one runs and reuse pipes unless output is compared. Time from release to exit." << std::endl;
+    std::cout << "  --profile=<file>      Sample user stacks of the command into a collapsed stack file, per command" << std::endl;
+    std::cout << "                        <file>.<n> if there are several. Needs frame pointers in the command." << std::endl;
+    std::cout << "  --profile-every=<x>   Sample an extra run after every x-th iteration, kept out of the statistics. Default is 1." << std::endl;
+    std::cout << "  --profile-freq=<hz>   Stack samples per second of CPU time. Default is 997." << std::endl;
+    std::cout << "  --progress            Show live progress and running statistics on stderr (tty only)." << std::endl;
     std::cout << "  --ref-stdout=<file>   Enable stdout reference comparison to file contents. If stdout differ then fail execution." << std::endl;
     std::cout << "  --ref-stderr=<file>   Enable stderr reference comparison to file contents. If stderr differ then fail execution." << std::endl;
+    std::cout << "  --seed=<x>            Seed of the random execution order of several commands." << std::endl;
+    std::cout << "  --timeout=<s>         Terminate an iteration after the given seconds, counted as failed." << std::endl;
+    std::cout << "  --token-file=<file>   Shared secret an agent requires from its coordinators, read from the file on both sides." << std::endl;
+    std::cout << "  --total-timeout=<s>   Stop iterating after the given seconds in total." << std::endl;
     std::cout << "  --version             Print out version information." << std::endl;
     std::cout << std::endl;
     std::cout << "                  Copyright (C) " PROGRAM_YEAR ". Licensed under " PROGRAM_LICENSE "." << std::endl;
@@ -56,6 +91,15 @@ std::string join(const T &list, const std::string delimiter) {
     return result;
 }
 
+// A whole argument as a number, std::invalid_argument or std::out_of_range otherwise
+double to_number(const std::string &text, const bool integral = false) {
+    std::size_t used = 0;
+    double value = std::stod(text, &used);
+    if (used != text.length() || (integral && value != std::floor(value)))
+        throw std::invalid_argument("Not a number: " + text);
+    return value;
+}
+
 std::string get_file_contents(const std::string &filename) {
     std::stringstream content;
     std::ifstream stream(filename);
@@ -70,8 +114,18 @@ std::string get_file_contents(const std::string &filename) {
 
 int main(int argc, const char *argv[]) {
     // Parse arguments
-    std::vector<std::string> command;
+    std::vector<std::vector<std::string>> commands(1);
+    std::vector<std::string> control;
+    std::vector<std::vector<std::string>> environments;
+    std::vector<std::string> ok_classes {process::classify(0, 0)};
+    std::mt19937::result_type seed {std::random_device{}()};
     bool colorize {false};
+    bool show_progress {false};
+    bool show_graph {false};
+    bool prespawn {false};
+    std::string profile_file {""};
+    unsigned int profile_every {1};
+    unsigned int profile_frequency {997};
     unsigned int iterations {1};
     bool stdout_compare {false};
     bool stderr_compare {false};
@@ -79,15 +133,31 @@ int main(int argc, const char *argv[]) {
     bool stderr_ref_set {false};
     std::string stdout_reference {""};
     std::string stderr_reference {""};
+    std::unique_ptr<pipes::mapped_file> input;
+    std::string agent_address {""};
+    std::string token {""};
+    std::vector<std::string> hosts;
+    std::chrono::milliseconds timeout {0};
+    std::chrono::milliseconds total_timeout {0};
     bool skip_next_arg {false};
     bool command_detected {false};
 
+    // Value of a key-value option, given as --key=value or as --key value
+    std::function<std::string (const console::arg_t &)> option_value = [&skip_next_arg] (const console::arg_t &arg) {
+        if (arg.value.length() > 0 || !arg.next)
+            return arg.value;
+        skip_next_arg = true;
+        return arg.next->key;
+    };
+
     for(const auto &arg: console::parse_args(argc, argv)) {
         if (command_detected) {
-            if (arg.value.length() > 0)
-                command.push_back(arg.key + "=" + arg.value);
+            if (arg.key == ":::")
+                commands.emplace_back();
+            else if (arg.value.length() > 0)
+                commands.back().push_back(arg.key + "=" + arg.value);
             else
-                command.push_back(arg.key);
+                commands.back().push_back(arg.key);
             continue;
         }
         if(skip_next_arg) {
@@ -106,6 +176,15 @@ int main(int argc, const char *argv[]) {
         else if(arg.key == "--color") {
             colorize = true;
         }
+        else if(arg.key == "--graph") {
+            show_graph = true;
+        }
+        else if(arg.key == "--prespawn") {
+            prespawn = true;
+        }
+        else if(arg.key == "--progress") {
+            show_progress = true;
+        }
         else if (arg.key == "--cmp-stdout") {
             stdout_compare = true;
         }
@@ -130,6 +209,126 @@ int main(int argc, const char *argv[]) {
                 std::cerr << console::color::red << PROGRAM_NAME << ": --ref-stderr exception: " << e.what() << console::color::reset << std::endl;
             }
         }
+        else if (arg.key == "--control") {
+            std::istringstream words(arg.value);
+            std::string word;
+            while (words >> word)
+                control.push_back(word);
+        }
+        else if (arg.key == "--env") {
+            std::string definition = arg.value;
+            if (definition.length() == 0 && arg.next) {
+                definition = arg.next->key;
+                skip_next_arg = true;
+            }
+            std::string::size_type offset_equal_sign = definition.find('=');
+            if (offset_equal_sign == std::string::npos || offset_equal_sign == 0) {
+                std::cerr << console::color::red << PROGRAM_NAME << ": Invalid --env argument, expected <key>=<values>: \"" << definition << "\"" << console::color::reset << std::endl;
+                return 1;
+            }
+            const std::string key = definition.substr(0, offset_equal_sign + 1);
+            std::istringstream list(definition.substr(offset_equal_sign + 1));
+            std::string value;
+            environments.emplace_back();
+            while (std::getline(list, value, ','))
+                environments.back().push_back(key + value);
+            if (environments.back().size() == 0)
+                environments.back().push_back(key);
+        }
+        else if (arg.key == "--profile") {
+            profile_file = arg.value;
+        }
+        else if (arg.key == "--profile-every" || arg.key == "--profile-freq") {
+            const std::string value = option_value(arg);
+            try {
+                double temp = to_number(value, true);
+                if (temp < 1 || temp > std::numeric_limits<unsigned int>::max())
+                    throw std::out_of_range(value);
+                (arg.key == "--profile-every" ? profile_every : profile_frequency) = static_cast<unsigned int>(temp);
+            }
+            catch (const std::exception &) {
+                std::cerr << console::color::red << PROGRAM_NAME << ": Invalid " << arg.key << " argument, ignoring: " << value << console::color::reset << std::endl;
+            }
+        }
+        else if (arg.key == "--ok-exit") {
+            const std::string value = option_value(arg);
+            std::istringstream list(value);
+            std::string code;
+            std::vector<std::string> classes;
+            try {
+                while (std::getline(list, code, ',')) {
+                    double temp = to_number(code, true);
+                    if (temp < 0 || temp > 255)
+                        throw std::out_of_range(code);
+                    classes.push_back(process::classify(static_cast<int>(temp), 0));
+                }
+            }
+            catch (const std::exception &) {
+                classes.clear();
+            }
+            if (classes.size() > 0)
+                ok_classes = classes;
+            else
+                std::cerr << console::color::red << PROGRAM_NAME << ": Invalid --ok-exit argument, ignoring: " << value << console::color::reset << std::endl;
+        }
+        else if (arg.key == "--seed") {
+            const std::string value = option_value(arg);
+            try {
+                double temp = to_number(value, true);
+                if (temp < 0 || temp > std::numeric_limits<std::mt19937::result_type>::max())
+                    throw std::out_of_range(value);
+                seed = static_cast<std::mt19937::result_type>(temp);
+            }
+            catch (const std::exception &) {
+                std::cerr << console::color::red << PROGRAM_NAME << ": Invalid --seed argument, ignoring: " << value << console::color::reset << std::endl;
+            }
+        }
+        else if (arg.key == "--timeout" || arg.key == "--total-timeout") {
+            const std::string value = option_value(arg);
+            double seconds = 0.0;
+            try {
+                seconds = to_number(value);
+            }
+            catch (const std::exception &) {
+            }
+            if (seconds > 0.0 && seconds < 1e9)
+                (arg.key == "--timeout" ? timeout : total_timeout) = std::chrono::milliseconds(static_cast<long>(seconds * 1000.0));
+            else
+                std::cerr << console::color::red << PROGRAM_NAME << ": Invalid " << arg.key << " argument, ignoring: " << value << console::color::reset << std::endl;
+        }
+        else if (arg.key == "--agent") {
+            agent_address = arg.value;
+        }
+        else if (arg.key == "--token-file") {
+            try {
+                token = get_file_contents(arg.value);
+            }
+            catch (const std::exception &e) {
+                std::cerr << console::color::red << PROGRAM_NAME << ": --token-file exception: " << e.what() << console::color::reset << std::endl;
+                return 1;
+            }
+            token.erase(token.find_last_not_of(" \t\r\n") + 1);
+            if (token.length() == 0) {
+                std::cerr << console::color::red << PROGRAM_NAME << ": --token-file is empty: " << arg.value << console::color::reset << std::endl;
+                return 1;
+            }
+        }
+        else if (arg.key == "--hosts") {
+            std::istringstream list(arg.value);
+            std::string host;
+            while (std::getline(list, host, ','))
+                if (host.length() > 0)
+                    hosts.push_back(host);
+        }
+        else if (arg.key == "--input") {
+            try {
+                input = std::make_unique<pipes::mapped_file>(arg.value);
+            }
+            catch (const std::exception &e) {
+                std::cerr << console::color::red << PROGRAM_NAME << ": --input exception: " << e.what() << console::color::reset << std::endl;
+                return 1;
+            }
+        }
         else if (arg.key == "-i" && arg.next) {
             int temp = std::stoi(arg.next->key); // TODO: sanity check
             if (temp >= 1)
@@ -146,9 +345,9 @@ int main(int argc, const char *argv[]) {
         }
         else {
             if (arg.value.length() > 0)
-                command.push_back(arg.key + "=" + arg.value);
+                commands.back().push_back(arg.key + "=" + arg.value);
             else
-                command.push_back(arg.key);
+                commands.back().push_back(arg.key);
             command_detected = true;
         }
     }
@@ -156,47 +355,308 @@ int main(int argc, const char *argv[]) {
     // Set console properties
     console::color::enable = colorize;
 
-    // Determine tty width
-    //~ int columns;
-    //~ {
-        //~ console::tty temp;
-        //~ columns = temp.cols;
-    //~ }
+    if (agent_address.length() > 0) {
+        try {
+            remote::serve(remote::parse_address(agent_address), token, std::cerr);
+        }
+        catch (const std::exception &e) {
+            std::cerr << console::color::red << PROGRAM_NAME << ": --agent exception: " << e.what() << console::color::reset << std::endl;
+            return 1;
+        }
+    }
+
+    for (const auto &command: commands) {
+        if (command.size() == 0) {
+            std::cerr << console::color::red << PROGRAM_NAME << ": No command given" << console::color::reset << std::endl;
+            return 1;
+        }
+    }
+    const std::vector<std::string> &command = commands.front();
 
-    if (command.size() == 0) {
-        std::cerr << console::color::red << PROGRAM_NAME << ": No command given" << console::color::reset << std::endl;
+    // Summary of all samples, followed by a breakdown per series if there are several
+    std::function<void (const std::vector<double> &, const std::vector<graph::series_t> &)> print_report = [&] (const std::vector<double> &values, const std::vector<graph::series_t> &series) {
+#ifdef DEBUG
+        std::string cmd = join(command, " ");
+        std::cout << PROGRAM_NAME << ": cmd \"" << cmd << "\"" << std::endl;
+#endif
+        report::summary(std::cout, PROGRAM_NAME ": ", values, 1000.0, "ms");
+        for (std::size_t index = 0; index < series.size() && series.size() > 1; index++)
+            report::brief(std::cout, PROGRAM_NAME ": ", series[index].label, series[index].values, 1.0, "ms");
+
+        if (show_graph) {
+            console::tty screen {STDOUT_FILENO};
+            graph::render(std::cout, series, screen.cols, PROGRAM_NAME ": ", "ms");
+        }
+    };
+
+    // Samples are only summarized together with others of the same outcome,
+    // so that fast failing runs do not distort the successful ones
+    using failures_t = std::map<std::string, std::vector<double>>;
+    std::function<void (const std::vector<double> &, const std::vector<std::string> &, std::vector<double> &, failures_t &)> split_outcomes = [&] (const std::vector<double> &samples, const std::vector<std::string> &classes, std::vector<double> &successful, failures_t &failed) {
+        for (std::size_t index = 0; index < samples.size(); index++) {
+            if (std::find(ok_classes.begin(), ok_classes.end(), classes[index]) != ok_classes.end())
+                successful.push_back(samples[index]);
+            else
+                failed[classes[index]].push_back(samples[index]);
+        }
+    };
+
+    // Returns whether any execution succeeded
+    std::function<bool (const std::vector<double> &, const failures_t &)> print_failures = [] (const std::vector<double> &successful, const failures_t &failed) {
+        if (successful.size() == 0)
+            std::cerr << console::color::red << PROGRAM_NAME << ": No successful executions, see --ok-exit" << console::color::reset << std::endl;
+        if (failed.size() == 0)
+            return successful.size() > 0;
+
+        std::size_t total = successful.size();
+        for (const auto &failure: failed)
+            total += failure.second.size();
+        std::cout << PROGRAM_NAME << ": successful........................" << successful.size() << "/" << total << std::endl;
+        for (const auto &failure: failed)
+            report::brief(std::cout, PROGRAM_NAME ": ", "  " + ((failure.first == "timeout") ? "timeout (censored)" : failure.first), failure.second, 1000.0, "ms");
+        return successful.size() > 0;
+    };
+
+    if (hosts.size() > 0) {
+        if (commands.size() > 1 || control.size() > 0 || environments.size() > 0 || profile_file.length() > 0) {
+            std::cerr << console::color::red << PROGRAM_NAME << ": --hosts supports a single command only, without --control, --env or --profile" << console::color::reset << std::endl;
+            return 1;
+        }
+
+        // Options applied by the local launcher only, agents would silently ignore them
+        std::vector<std::string> local_only;
+        for (const auto &option: std::vector<std::pair<bool, const char *>> {
+                {input != nullptr, "--input"}, {timeout.count() > 0, "--timeout"}, {total_timeout.count() > 0, "--total-timeout"},
+                {prespawn, "--prespawn"}, {show_progress, "--progress"}, {stdout_compare, "--cmp-stdout"}, {stderr_compare, "--cmp-stderr"},
+                {stdout_ref_set, "--ref-stdout"}, {stderr_ref_set, "--ref-stderr"}}) {
+            if (option.first)
+                local_only.push_back(option.second);
+        }
+        if (local_only.size() > 0) {
+            std::cerr << console::color::red << PROGRAM_NAME << ": --hosts does not support " << join(local_only, ", ") << console::color::reset << std::endl;
+            return 1;
+        }
+
+        std::vector<double> values;
+        std::vector<graph::series_t> series;
+        failures_t failed;
+        bool host_failed {false};
+        for (const auto &result: remote::coordinate(hosts, command, iterations, token)) {
+            if (result.error.length() > 0) {
+                host_failed = true;
+                std::cerr << console::color::red << PROGRAM_NAME << ": " << result.name << ": " << result.error << console::color::reset << std::endl;
+                if (result.samples.size() == 0)
+                    continue;
+            }
+            std::vector<double> samples;
+            std::vector<std::string> classes;
+            for (const auto &sample: result.samples) {
+                samples.push_back(sample.elapsed);
+                classes.push_back(sample.outcome());
+            }
+            std::vector<double> successful;
+            split_outcomes(samples, classes, successful, failed);
+
+            series.push_back(graph::series_t {"host " + result.name, {}});
+            for (const auto &value: successful) {
+                values.push_back(value);
+                series.back().values.push_back(value / 1000.0);
+            }
+        }
+        if (values.size() == 0 && failed.size() == 0) {
+            std::cerr << console::color::red << PROGRAM_NAME << ": No time measurements generated" << console::color::reset << std::endl;
+            return host_failed ? 1 : 3;
+        }
+        print_report(values, series);
+        const bool succeeded = print_failures(values, failed);
+        if (host_failed) {
+            std::cerr << console::color::red << PROGRAM_NAME << ": Not all hosts completed their iterations" << console::color::reset << std::endl;
+            return 1;
+        }
+        return succeeded ? 0 : 3;
+    }
+
+    // Every command once per combination of --env values, each prepared once
+    // up front so that no iteration resolves PATH or builds argv/envp
+    std::vector<std::vector<std::string>> combinations(1);
+    for (const auto &values: environments) {
+        std::vector<std::vector<std::string>> expanded;
+        for (const auto &combination: combinations) {
+            for (const auto &value: values) {
+                expanded.push_back(combination);
+                expanded.back().push_back(value);
+            }
+        }
+        combinations.swap(expanded);
+    }
+
+    const std::vector<std::string> base_environment = process::current_environment();
+    std::vector<process::command_t> prepared;
+    std::vector<std::string> labels;
+    prepared.reserve(commands.size() * combinations.size() + 1);
+    try {
+        for (const auto &args: commands) {
+            for (const auto &combination: combinations) {
+                prepared.emplace_back(args, process::with_environment(base_environment, combination));
+                labels.push_back(join(combination, " ") + (combination.size() > 0 ? " " : "") + join(args, " "));
+            }
+        }
+        if (control.size() > 0) {
+            prepared.emplace_back(control, base_environment);
+            labels.push_back(join(control, " "));
+        }
+    }
+    catch (const std::exception &e) {
+        std::cerr << console::color::red << PROGRAM_NAME << ": " << e.what() << console::color::reset << std::endl;
         return 1;
     }
+    const std::size_t compared = prepared.size() - (control.size() > 0 ? 1 : 0);
+
+    // Stacks sampled per command during every profile_every-th iteration
+    std::vector<profile::collapsed> profiles;
+    if (profile_file.length() > 0) {
+        try {
+            profile::probe(profile_frequency);
+        }
+        catch (const std::exception &e) {
+            std::cerr << console::color::red << PROGRAM_NAME << ": --profile exception: " << e.what() << console::color::reset << std::endl;
+            return 1;
+        }
+        profiles.resize(compared);
+    }
+    std::vector<std::vector<double>> profiled_times(profiles.size());
+
+    // A child exiting without consuming its input must not terminate us
+    if (input)
+        signal(SIGPIPE, SIG_IGN);
+
+    // One round per iteration, running every command once
+    std::mt19937 generator {seed};
+    const std::vector<std::size_t> order = schedule::interleave(prepared.size(), iterations, generator);
 
     using time_resolution_t = std::chrono::microseconds;
-    std::vector<time_resolution_t> execution_times;
+    std::vector<std::vector<time_resolution_t>> execution_times(prepared.size());
+    for (auto &bucket: execution_times)
+        bucket.reserve(iterations);
+    std::vector<std::vector<std::string>> outcomes(prepared.size());
+    for (auto &classes: outcomes)
+        classes.reserve(iterations);
+
+    // Deadlines: per iteration, counted from its start, and for the whole run
+    const bool use_timeout = timeout.count() > 0 || total_timeout.count() > 0;
+    process::deadline_t total_deadline = process::deadline_t::max();
+    if (total_timeout.count() > 0)
+        total_deadline = std::chrono::steady_clock::now() + total_timeout;
+    std::function<process::deadline_t (process::deadline_t)> deadline_from = [&] (process::deadline_t begin) {
+        if (timeout.count() > 0)
+            return std::min(total_deadline, begin + timeout);
+        return total_deadline;
+    };
+
+    std::unique_ptr<progress::display> display;
+    if (show_progress && isatty(STDERR_FILENO))
+        display = std::make_unique<progress::display>(order.size());
+
+    // Pre-spawned pipeline: the next child is forked and parked before exec
+    // while the current one runs
+    std::unique_ptr<process::pipe_pool> pool;
+    std::function<std::unique_ptr<process::child> (std::size_t)> spawn = [&] (std::size_t index) {
+        return std::make_unique<process::child>(prepared[index], input.get(), pool.get(), use_timeout);
+    };
+    std::future<std::unique_ptr<process::child>> next;
+    const bool overlap_spawn = std::thread::hardware_concurrency() > 1;
+    if (prespawn) {
+        // Without pidfd_open() (before Linux 5.3) children get fresh pipes, as
+        // they do when output is compared: a reused pipe could carry output
+        // of processes the previous command left behind outside of its group
+        if (process::pidfd_supported() && !(stdout_compare || stderr_compare || stdout_ref_set || stderr_ref_set))
+            pool = std::make_unique<process::pipe_pool>();
+        next = std::async(std::launch::async, spawn, order.front());
+    }
 
-    for (unsigned int iteration = 0; iteration < iterations; iteration++) {
+    for (std::size_t position = 0; position < order.size(); position++) {
 #ifdef DEBUG
-        std::cout << PROGRAM_NAME <<  ": Iteration " << (iteration + 1) << "/" << iterations << std::endl;
+        std::cout << PROGRAM_NAME <<  ": Iteration " << (position / prepared.size() + 1) << "/" << iterations << ", command " << (order[position] + 1) << std::endl;
 #endif
+        const process::command_t &current_command = prepared[order[position]];
+        std::vector<time_resolution_t> &bucket = execution_times[order[position]];
         time_resolution_t elapsed;
-        std::future<process::exec_result_t> future = std::async(std::launch::async, [&] {
+        process::exec_result_t result;
+        const bool profiled = order[position] < profiles.size() && (position / prepared.size()) % profile_every == 0;
+        if (prespawn) {
+            // Fork the next child concurrently only when there is a spare
+            // CPU, otherwise it would compete with the one being measured
+            std::unique_ptr<process::child> current;
+            try {
+                current = next.get();
+            }
+            catch (const std::exception &e) {
+                display.reset();
+                std::cerr << console::color::red << PROGRAM_NAME << ": --prespawn exception: " << e.what() << console::color::reset << std::endl;
+                return 1;
+            }
+            if (position + 1 < order.size())
+                next = std::async(overlap_spawn ? std::launch::async : std::launch::deferred, spawn, order[position + 1]);
+
             auto begin = std::chrono::high_resolution_clock::now();
-            process::exec_result_t result = process::run(command);
+            process::deadline_t deadline = deadline_from(std::chrono::steady_clock::now());
+            current->release();
+            result = current->wait(deadline);
             auto end = std::chrono::high_resolution_clock::now();
             elapsed = std::chrono::duration_cast<time_resolution_t>(end-begin);
-            execution_times.push_back(elapsed);
-            return  result;
+            bucket.push_back(elapsed);
+        }
+        else {
+            std::future<process::exec_result_t> future = std::async(std::launch::async, [&] {
+                auto begin = std::chrono::high_resolution_clock::now();
+                process::exec_result_t outcome = process::run(current_command, input.get(), use_timeout ? deadline_from(std::chrono::steady_clock::now()) : process::deadline_t::max());
+                auto end = std::chrono::high_resolution_clock::now();
+                elapsed = std::chrono::duration_cast<time_resolution_t>(end-begin);
+                bucket.push_back(elapsed);
+                return outcome;
+
+            });
 
-        });
+            future.wait();
+            result = future.get();
+        }
 
-        future.wait();
-        process::exec_result_t result { future.get() };
+        // An extra execution under the sampler, kept out of the statistics.
+        // The sampler is attached between fork and exec, before timing starts.
+        if (profiled) {
+            process::child launched(current_command, input.get(), nullptr, use_timeout);
+            profile::sampler sampler(launched.id(), profile_frequency);
+            auto begin = std::chrono::high_resolution_clock::now();
+            launched.wait(use_timeout ? deadline_from(std::chrono::steady_clock::now()) : process::deadline_t::max());
+            auto end = std::chrono::high_resolution_clock::now();
+            profiles[order[position]].add(sampler);
+            profiled_times[order[position]].push_back(std::chrono::duration_cast<time_resolution_t>(end - begin).count());
+        }
 
+        // A timed out sample is kept, censored at the time of termination
+        outcomes[order[position]].push_back(process::classify(result));
+        if (result.timed_out) {
+            if (display)
+                display->update(elapsed.count());
+            if (std::chrono::steady_clock::now() >= total_deadline) {
+                display.reset();
+                std::cerr << console::color::red << PROGRAM_NAME << ": Total timeout reached after " << (position + 1) << "/" << order.size() << " executions" << console::color::reset << std::endl;
+                break;
+            }
+            continue;
+        }
+
+        // The control command prints something else than the compared ones
+        const bool compare_output = order[position] < compared;
         bool cmp_output_fail {false};
-        if (stdout_ref_set || stdout_compare) {
+        if (compare_output && (stdout_ref_set || stdout_compare)) {
             if (!stdout_ref_set) {
                 // Use first iteration's stdout as reference
                 stdout_reference = result.stdout;
                 stdout_ref_set = true;
             }
             else if (result.stdout != stdout_reference) {
+                display.reset();
                 std::cerr << console::color::red << PROGRAM_NAME << ": stdout comparison failed." << console::color::reset << std::endl;
                 std::cerr << console::color::red << PROGRAM_NAME << ":     expected:" << console::color::reset << std::endl;
                 std::cerr << stdout_reference << std::endl;
@@ -205,13 +665,14 @@ int main(int argc, const char *argv[]) {
                 cmp_output_fail = true;
             }
         }
-        if (stderr_ref_set || stderr_compare) {
+        if (compare_output && (stderr_ref_set || stderr_compare)) {
             if (!stderr_ref_set) {
                 // Use first iteration's stderr as reference
                 stderr_reference = result.stderr;
                 stderr_ref_set = true;
             }
             else if (result.stderr != stderr_reference) {
+                display.reset();
                 std::cerr << console::color::red << PROGRAM_NAME << ": stderr comparison failed." << console::color::reset << std::endl;
                 std::cerr << console::color::red << PROGRAM_NAME << ":     expected:" << console::color::reset << std::endl;
                 std::cerr << stderr_reference << std::endl;
@@ -223,6 +684,15 @@ int main(int argc, const char *argv[]) {
         if (cmp_output_fail)
             return 2;
 
+        if (display)
+            display->update(elapsed.count());
+
+        if (std::chrono::steady_clock::now() >= total_deadline) {
+            display.reset();
+            std::cerr << console::color::red << PROGRAM_NAME << ": Total timeout reached after " << (position + 1) << "/" << order.size() << " executions" << console::color::reset << std::endl;
+            break;
+        }
+
 #ifdef DEBUG
         std::cout << PROGRAM_NAME << ": Execution completed with code " << result.exit_code << ", took " << (elapsed.count() / 1000.0) << "ms" << std::endl;
 #endif
@@ -235,44 +705,95 @@ int main(int argc, const char *argv[]) {
 #endif
     }
 
-    if (execution_times.size() == 0) {
+    display.reset();
+
+    for (std::size_t index = 0; index < profiles.size(); index++) {
+        std::string filename = profile_file + (profiles.size() > 1 ? "." + std::to_string(index + 1) : "");
+        try {
+            profiles[index].write(filename);
+        }
+        catch (const std::exception &e) {
+            std::cerr << console::color::red << PROGRAM_NAME << ": --profile exception: " << e.what() << console::color::reset << std::endl;
+            continue;
+        }
+        std::cout << PROGRAM_NAME << ": profile..........................." << filename << " (" << profiles[index].samples << " stacks";
+        if (profiles[index].lost > 0)
+            std::cout << ", " << profiles[index].lost << " lost";
+        std::cout << ")" << std::endl;
+    }
+
+    if (execution_times.front().size() == 0) {
         std::cerr << console::color::red << PROGRAM_NAME << ": No time measurements generated" << console::color::reset << std::endl;
         return 3;
     }
 
-    std::function<unsigned long (const time_resolution_t &)> selector = [] (const auto &value) { return value.count(); };
-    statistics::statistics_t<unsigned long> s = statistics::calculate(execution_times, selector);
-
-    double standard_deviation1 {0.0};
-    double standard_deviation2 {0.0};
-    double standard_deviation3 {0.0};
-    for (const auto &item: execution_times) {
-        auto value = selector(item);
-        if (value >= std::min(std::numeric_limits<double>::min(), s.average - s.standard_deviation) && value <= (s.average + s.standard_deviation))
-            standard_deviation1++;
-        if (value >= std::min(std::numeric_limits<double>::min(), s.average - 2 * s.standard_deviation) && value <= (s.average + 2 * s.standard_deviation))
-            standard_deviation2++;
-        if (value >= std::min(std::numeric_limits<double>::min(), s.average - 3 * s.standard_deviation) && value <= (s.average + 3 * s.standard_deviation))
-            standard_deviation3++;
+    std::vector<std::vector<unsigned long>> values(prepared.size());
+    for (std::size_t index = 0; index < prepared.size(); index++) {
+        for (const auto &item: execution_times[index])
+            values[index].push_back(item.count());
     }
 
-    // Dump result
-#ifdef DEBUG
-    std::string cmd = join(command, " ");
-    std::cout << PROGRAM_NAME << ": cmd \"" << cmd << "\"" << std::endl;
-#endif
-    //std::cout << PROGRAM_NAME << ": minimum..........................." << (s.minimum / 1000.0) << "ms" << std::endl;
-    //std::cout << PROGRAM_NAME << ": maximum..........................." << (s.maximum / 1000.0) << "ms" << std::endl;
-    std::cout << PROGRAM_NAME << ": range............................." << ((s.maximum - s.minimum) / 1000.0) << "ms (" << (s.minimum / 1000.0) << "-" << (s.maximum / 1000.0) << "ms)" << std::endl;
-    std::cout << PROGRAM_NAME << ": average/mean......................" << (s.average / 1000.0) << "ms" << std::endl;
-    std::cout << PROGRAM_NAME << ": median............................" << (s.median / 1000.0) << "ms" << std::endl;
-    //std::cout << PROGRAM_NAME << ": variance.........................." << (s.variance / 1000.0) << std::endl;
-    std::cout << PROGRAM_NAME << ": std. deviation...................." << (s.standard_deviation / 1000.0) << "ms (" << ((s.average - s.standard_deviation) / 1000.0) << "-" << ((s.average + s.standard_deviation) / 1000.0) << "ms)" << std::endl;
-    std::cout << PROGRAM_NAME << ": norm. distr. mean±1σ (68.27%)....." << ((static_cast<double>(standard_deviation1) / s.sample_size) * 100.0) << "% (" << standard_deviation1 << "/" << s.sample_size << ")" << std::endl;
-    std::cout << PROGRAM_NAME << ":              mean±2σ (95.45%)....." << ((static_cast<double>(standard_deviation2) / s.sample_size) * 100.0) << "% (" << standard_deviation2 << "/" << s.sample_size << ")" << std::endl;
-    std::cout << PROGRAM_NAME << ":              mean±3σ (99.73%)....." << ((static_cast<double>(standard_deviation3) / s.sample_size) * 100.0) << "% (" << standard_deviation3 << "/" << s.sample_size << ")" << std::endl;
-    std::cout << PROGRAM_NAME << ": std. error........................" << s.standard_error << " (relative: " << s.relative_standard_error << "%)" << std::endl;
-
-    // TODO: render graph(s)
-    return 0;
+    std::function<void (std::size_t)> print_profiled = [&] (std::size_t index) {
+        if (index < profiled_times.size() && profiled_times[index].size() > 0)
+            report::brief(std::cout, PROGRAM_NAME ": ", "  profiled (excluded)", profiled_times[index], 1000.0, "ms");
+    };
+
+    if (prepared.size() == 1) {
+        std::vector<double> successful;
+        failures_t failed;
+        split_outcomes(std::vector<double>(values.front().begin(), values.front().end()), outcomes.front(), successful, failed);
+
+        graph::series_t series {labels.front(), {}};
+        series.values.reserve(successful.size());
+        for (const auto &value: successful)
+            series.values.push_back(value / 1000.0);
+        print_report(successful, {series});
+        const bool succeeded = print_failures(successful, failed);
+        print_profiled(0);
+        return succeeded ? 0 : 3;
+    }
+
+    // Several commands: correct every round for the drift seen by the control
+    std::vector<double> factors(iterations, 1.0);
+    if (control.size() > 0) {
+        std::vector<bool> valid;
+        for (const auto &outcome: outcomes.back())
+            valid.push_back(std::find(ok_classes.begin(), ok_classes.end(), outcome) != ok_classes.end());
+        factors = schedule::drift(values.back(), valid);
+    }
+
+    std::vector<graph::series_t> series;
+    bool all_succeeded {true};
+    for (std::size_t index = 0; index < compared; index++) {
+        std::vector<double> corrected;
+        for (std::size_t round = 0; round < values[index].size(); round++)
+            corrected.push_back(values[index][round] / (round < factors.size() ? factors[round] : 1.0));
+
+        std::vector<double> successful;
+        failures_t failed;
+        split_outcomes(corrected, outcomes[index], successful, failed);
+
+        std::cout << PROGRAM_NAME << ": command " << (index + 1) << ": " << labels[index] << std::endl;
+        report::summary(std::cout, PROGRAM_NAME ": ", successful, 1000.0, "ms");
+        if (!print_failures(successful, failed))
+            all_succeeded = false;
+        print_profiled(index);
+
+        series.push_back(graph::series_t {"[" + std::to_string(index + 1) + "] " + labels[index], {}});
+        for (const auto &value: successful)
+            series.back().values.push_back(value / 1000.0);
+    }
+
+    if (control.size() > 0) {
+        auto bounds = std::minmax_element(factors.begin(), factors.end());
+        std::cout << PROGRAM_NAME << ": drift (control)..................." << std::showpos << ((*bounds.first - 1.0) * 100.0) << "% to " << ((*bounds.second - 1.0) * 100.0) << std::noshowpos << "%, corrected" << std::endl;
+    }
+    for (const auto &s: series)
+        report::brief(std::cout, PROGRAM_NAME ": ", graph::truncate(s.label, 30), s.values, 1.0, "ms");
+
+    if (show_graph) {
+        console::tty screen {STDOUT_FILENO};
+        graph::render(std::cout, series, screen.cols, PROGRAM_NAME ": ", "ms");
+    }
+    return all_succeeded ? 0 : 3;
 }
@@ -8,7 +8,12 @@
 #include <vector>
 
 #include <sys/poll.h>
-#include <unistd.h> // STDIN_FILENO
+#include <sys/mman.h> // mmap(), madvise()
+#include <sys/stat.h> // fstat()
+#include <sys/uio.h> // struct iovec
+#include <fcntl.h> // open(), vmsplice()
+#include <errno.h>
+#include <unistd.h> // STDIN_FILENO, read(), write()
 
 namespace pipes {
     class pipe {
@@ -55,6 +60,106 @@ namespace pipes {
         return ss.str();
     }
 
+    // Read-only memory mapping of a whole file, populated up front so that
+    // page faults are not paid for while feeding it to a child process.
+    class mapped_file {
+        private:
+            void *address {nullptr};
+            std::size_t length {0};
+        public:
+            mapped_file(const std::string &filename) {
+                int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd < 0)
+                    throw std::runtime_error("Failed to open file for reading: " + filename);
+
+                struct stat info;
+                if (fstat(fd, &info) != 0) {
+                    close(fd);
+                    throw std::runtime_error("fstat(): " + std::to_string(errno));
+                }
+
+                length = info.st_size;
+                if (length > 0) {
+                    address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+                    if (address == MAP_FAILED) {
+                        address = nullptr;
+                        close(fd);
+                        throw std::runtime_error("mmap(): " + std::to_string(errno));
+                    }
+                    madvise(address, length, MADV_SEQUENTIAL | MADV_WILLNEED);
+                }
+                close(fd);
+            }
+
+            mapped_file(const mapped_file &) = delete;
+            mapped_file &operator=(const mapped_file &) = delete;
+
+            ~mapped_file() {
+                if (address)
+                    munmap(address, length);
+                address = nullptr;
+            }
+
+            const char *data() const {
+                return static_cast<const char *>(address);
+            }
+
+            std::size_t size() const {
+                return length;
+            }
+    };
+
+    // Append whatever is available on fd to output. Returns false on end of file.
+    inline bool read_available(const int fd, std::string &output) {
+        char buffer[65536];
+        while (true) {
+            ssize_t count = ::read(fd, buffer, sizeof(buffer));
+            if (count > 0) {
+                output.append(buffer, count);
+                return true;
+            }
+            if (count == 0)
+                return false;
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return true;
+            throw std::runtime_error("read() pipe: " + std::to_string(errno));
+        }
+    }
+
+    // Move as much of data as the (non-blocking) pipe accepts without copying,
+    // by handing the pages over with vmsplice(). Falls back to write() where
+    // vmsplice() is not supported. Returns the number of bytes consumed, or -1
+    // if the reading end has been closed.
+    inline ssize_t write_available(const int fd, const char *data, const std::size_t size) {
+        static bool splice_supported {true};
+        while (true) {
+            ssize_t count;
+            if (splice_supported) {
+                struct iovec chunk {const_cast<char *>(data), size};
+                count = vmsplice(fd, &chunk, 1, SPLICE_F_NONBLOCK);
+                if (count < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                    splice_supported = false;
+                    continue;
+                }
+            }
+            else {
+                count = ::write(fd, data, size);
+            }
+
+            if (count >= 0)
+                return count;
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+            if (errno == EPIPE)
+                return -1;
+            throw std::runtime_error("write() pipe: " + std::to_string(errno));
+        }
+    }
+
     bool stdin_has_data(int timeout = 0) {
         if (timeout < 0)
             return true; // Force read (blocking)
@@ -7,18 +7,52 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <sstream>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <cstring>
+#include <chrono>
 
-#include <unistd.h> // close(), fork(), execv(), dup2(), STDOUT_FILENO, STDERR_FILENO
-#include <sys/wait.h> // waitpid()
-#include <string.h> // strdup()
+#include <unistd.h> // close(), fork(), execve(), dup2(), access(), environ, pipe2(), syscall(), STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO
+#include <sys/syscall.h> // SYS_pidfd_open, SYS_close_range
+#include <fcntl.h> // fcntl(), O_CLOEXEC, O_NONBLOCK, F_SETPIPE_SZ
+#include <signal.h> // signal(), sigaction(), kill(), raise()
+#include <poll.h> // poll()
+#include <sys/wait.h> // waitpid(), waitid()
+#include <sys/stat.h> // stat()
+#include <string.h> // strerror(), sigabbrev_np(), strlen()
 
 namespace process {
     struct exec_result_t {
-        int exit_code;
+        int exit_code; // -1 unless exited normally
         std::string stdout;
         std::string stderr;
+        bool timed_out {false};
+        int signal {0}; // Terminating signal, 0 unless killed
     };
 
+    // Outcome class of an execution: "exit <code>", "signal <n> (SIG<name>)" or "timeout"
+    inline std::string classify(const int exit_code, const int signal, const bool timed_out = false) {
+        if (timed_out)
+            return "timeout";
+        if (signal > 0) {
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 32)
+            const char *name = sigabbrev_np(signal);
+            if (name)
+                return "signal " + std::to_string(signal) + " (SIG" + name + ")";
+#endif
+            return "signal " + std::to_string(signal);
+        }
+        return "exit " + std::to_string(exit_code);
+    }
+
+    inline std::string classify(const exec_result_t &result) {
+        return classify(result.exit_code, result.signal, result.timed_out);
+    }
+
+    using deadline_t = std::chrono::steady_clock::time_point;
+
 #ifdef FALSE
     exec_result_t run(const std::string &command) {
         FILE* fp = popen(command.c_str(), "r");
@@ -40,88 +74,584 @@ namespace process {
     }
 #endif
 
-    exec_result_t run(const std::vector<std::string> &command) {
-        if (command.size() == 0)
-            throw std::runtime_error("No command given");
+    // Environment of exectime itself, as KEY=VALUE entries
+    inline std::vector<std::string> current_environment() {
+        std::vector<std::string> result;
+        for (char **entry = environ; entry && *entry; entry++)
+            result.emplace_back(*entry);
+        return result;
+    }
 
-        int fd_stdout[2]; // [0]=read, [1]=write
-        if (pipe(fd_stdout) != 0)
-            throw std::runtime_error("pipe() stdout:" + std::to_string(errno));
+    // Environment with the given KEY=VALUE entries added or replaced
+    inline std::vector<std::string> with_environment(std::vector<std::string> environment, const std::vector<std::string> &overrides) {
+        for (const auto &entry: overrides) {
+            std::string prefix = entry.substr(0, entry.find('=') + 1);
+            auto existing = std::find_if(environment.begin(), environment.end(), [&prefix] (const std::string &item) {
+                return item.compare(0, prefix.length(), prefix) == 0;
+            });
+            if (existing != environment.end())
+                *existing = entry;
+            else
+                environment.push_back(entry);
+        }
+        return environment;
+    }
 
-        int fd_stderr[2]; // [0]=read, [1]=write
-        if (pipe(fd_stderr) != 0)
-            throw std::runtime_error("pipe() stderr:" + std::to_string(errno));
+    // Locate an executable like execvp() would, names containing a slash are used as is
+    inline std::string resolve(const std::string &name, const std::vector<std::string> &environment) {
+        if (name.find('/') != std::string::npos)
+            return name;
 
-        pid_t pid = fork(); // TODO: use vfork() instead?
-        if (pid < 0)
-            throw std::runtime_error("fork(): " + std::to_string(errno));
+        std::string path {"/usr/local/bin:/usr/bin:/bin"};
+        for (const auto &entry: environment) {
+            if (entry.compare(0, 5, "PATH=") == 0)
+                path = entry.substr(5);
+        }
 
-        bool is_parent = (pid > 0);
-        if (is_parent) {
-            // Parent process
-            close(fd_stdout[1]);
-            close(fd_stderr[1]);
+        std::istringstream directories(path);
+        std::string directory;
+        while (std::getline(directories, directory, ':')) {
+            std::string candidate = (directory.length() > 0 ? directory : ".") + "/" + name;
+            struct stat info;
+            if (stat(candidate.c_str(), &info) == 0 && S_ISREG(info.st_mode) && access(candidate.c_str(), X_OK) == 0)
+                return candidate;
+        }
+        throw std::runtime_error("Command not found in PATH: \"" + name + "\"");
+    }
 
-            int status;
-            pid_t ws = waitpid(pid, &status, 0);
-            if (ws != pid)
-                throw std::runtime_error("Failed to wait for pid " + std::to_string(pid));
+    // A command prepared once for any number of executions. The executable
+    // is resolved against PATH up front and argv/envp point into a single
+    // immutable arena, so launching it allocates nothing.
+    class command_t {
+        private:
+            std::vector<char> arena;
+            std::vector<char *> argv;
+            std::vector<char *> envp;
+            std::size_t executable_offset {0};
+        public:
+            command_t(const std::vector<std::string> &args, const std::vector<std::string> &environment = current_environment()) {
+                if (args.size() == 0)
+                    throw std::runtime_error("No command given");
 
-            std::string output_stdout = pipes::read_pipe(fd_stdout[0]);
-            close(fd_stdout[0]);
+                std::string executable = resolve(args.front(), environment);
+                std::size_t size = executable.length() + 1;
+                for (const auto &item: args)
+                    size += item.length() + 1;
+                for (const auto &item: environment)
+                    size += item.length() + 1;
+                arena.reserve(size);
 
-            std::string output_stderr = pipes::read_pipe(fd_stderr[0]);
-            close(fd_stderr[0]);
+                std::vector<std::size_t> offsets;
+                for (const auto *list: {&args, &environment}) {
+                    for (const auto &item: *list) {
+                        offsets.push_back(arena.size());
+                        arena.insert(arena.end(), item.begin(), item.end());
+                        arena.push_back('\0');
+                    }
+                }
+                executable_offset = arena.size();
+                arena.insert(arena.end(), executable.begin(), executable.end());
+                arena.push_back('\0');
 
-            int exit_code = -1;
-            if (WIFEXITED(status)) {
-                exit_code = WEXITSTATUS(status);
+                for (std::size_t index = 0; index < offsets.size(); index++)
+                    (index < args.size() ? argv : envp).push_back(arena.data() + offsets[index]);
+                argv.push_back(nullptr);
+                envp.push_back(nullptr);
             }
-#ifdef DEBUG
-            else if (WIFSIGNALED(status)) {
-                if (output_stderr.length() > 0)
-                    output_stderr += '\n';
-                output_stderr += "killed by signal " + std::to_string(WTERMSIG(status)) + "\n";
-            }
-            else if (WIFSTOPPED(status)) {
-                if (output_stderr.length() > 0)
-                    output_stderr += '\n';
-                output_stderr += "stopped by signal " + std::to_string(WSTOPSIG(status)) + "\n";
-            }
-            else if (WIFCONTINUED(status)) {
-                if (output_stderr.length() > 0)
-                    output_stderr += '\n';
-                output_stderr += "continued\n";
-            }
-            else {
-                if (output_stderr.length() > 0)
-                    output_stderr += '\n';
-                output_stderr += "unhandled exit status\n";
+
+            command_t(const command_t &) = delete;
+            command_t &operator=(const command_t &) = delete;
+            command_t(command_t &&) = default;
+            command_t &operator=(command_t &&) = default;
+
+            const char *executable() const {
+                return arena.data() + executable_offset;
+            }
+
+            char *const *arguments() const {
+                return argv.data();
+            }
+
+            char *const *environment() const {
+                return envp.data();
+            }
+    };
+
+    // Process groups of running commands. Commands in their own group do not
+    // see a Ctrl-C on the terminal, so exectime forwards it before it exits.
+    namespace groups {
+        constexpr std::size_t capacity {64};
+        inline std::atomic<pid_t> active[capacity];
+
+        // Only async-signal-safe calls, this is the signal handler
+        inline void forward(const int signal_number) {
+            for (auto &leader: active) {
+                pid_t pid = leader.load();
+                if (pid > 0)
+                    kill(-pid, signal_number);
             }
+            ::signal(signal_number, SIG_DFL);
+            raise(signal_number);
+        }
+
+        inline void add(const pid_t pid) {
+            static std::once_flag installed;
+            std::call_once(installed, [] {
+                for (int signal_number: {SIGINT, SIGTERM, SIGHUP, SIGQUIT}) {
+                    struct sigaction action;
+                    std::memset(&action, 0, sizeof(action));
+                    action.sa_handler = forward;
+                    sigemptyset(&action.sa_mask);
+                    sigaction(signal_number, &action, nullptr);
+                }
+            });
+            for (auto &leader: active) {
+                pid_t expected = 0;
+                if (leader.compare_exchange_strong(expected, pid))
+                    return;
+            }
+        }
+
+        // Before the leader is reaped, its pid may be reused afterwards
+        inline void remove(const pid_t pid) {
+            for (auto &leader: active) {
+                pid_t expected = pid;
+                if (leader.compare_exchange_strong(expected, 0))
+                    return;
+            }
+        }
+    }
+
+    // Output pipes of one child, [0]=read, [1]=write
+    struct output_pipes_t {
+        int stdout[2] {-1, -1};
+        int stderr[2] {-1, -1};
+    };
+
+    // Output pipes kept open between children, saving pipe creation per
+    // iteration. As exectime holds on to the write ends the children's
+    // completion is detected through a pidfd instead of end of file. For the
+    // same reason background processes of a finished command may still write
+    // into them, so pipes are only returned when no one else can hold them.
+    class pipe_pool {
+        private:
+            std::mutex lock;
+            std::vector<output_pipes_t> available;
+        public:
+            pipe_pool() {
+            }
+
+            pipe_pool(const pipe_pool &) = delete;
+            pipe_pool &operator=(const pipe_pool &) = delete;
+
+            ~pipe_pool() {
+                for (auto &pipes: available) {
+                    for (int fd: {pipes.stdout[0], pipes.stdout[1], pipes.stderr[0], pipes.stderr[1]})
+                        close(fd);
+                }
+            }
+
+            output_pipes_t acquire() {
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    if (available.size() > 0) {
+                        output_pipes_t pipes = available.back();
+                        available.pop_back();
+                        return pipes;
+                    }
+                }
+
+                output_pipes_t pipes;
+                if (pipe2(pipes.stdout, O_CLOEXEC) != 0)
+                    throw std::runtime_error("pipe() stdout:" + std::to_string(errno));
+                if (pipe2(pipes.stderr, O_CLOEXEC) != 0)
+                    throw std::runtime_error("pipe() stderr:" + std::to_string(errno));
+                fcntl(pipes.stdout[0], F_SETFL, O_NONBLOCK);
+                fcntl(pipes.stderr[0], F_SETFL, O_NONBLOCK);
+                return pipes;
+            }
+
+            void release(const output_pipes_t &pipes) {
+                std::lock_guard<std::mutex> guard(lock);
+                available.push_back(pipes);
+            }
+    };
+
+    inline int pidfd_open(const pid_t pid) {
+#ifdef SYS_pidfd_open
+        return syscall(SYS_pidfd_open, pid, 0);
+#else
+        (void)pid;
+        errno = ENOSYS;
+        return -1;
+#endif
+    }
+
+    // Whether the kernel supports pidfd_open(), which pooled pipes rely on (Linux 5.3+)
+    inline bool pidfd_supported() {
+        int fd = pidfd_open(getpid());
+        if (fd < 0)
+            return false;
+        close(fd);
+        return true;
+    }
+
+    inline void close_from(const int lowest) {
+#ifdef SYS_close_range
+        if (syscall(SYS_close_range, lowest, ~0U, 0) == 0)
+            return;
 #endif
+        for (int fd = lowest; fd < sysconf(_SC_OPEN_MAX) && fd < 65536; fd++)
+            close(fd);
+    }
 
-            return exec_result_t {exit_code, output_stdout, output_stderr};
+    inline exec_result_t make_result(const int status, std::string &output_stdout, std::string &output_stderr) {
+        int exit_code = -1;
+        int signal = 0;
+        if (WIFEXITED(status)) {
+            exit_code = WEXITSTATUS(status);
+        }
+        else if (WIFSIGNALED(status)) {
+            signal = WTERMSIG(status);
+        }
+#ifdef DEBUG
+        else if (WIFSTOPPED(status)) {
+            if (output_stderr.length() > 0)
+                output_stderr += '\n';
+            output_stderr += "stopped by signal " + std::to_string(WSTOPSIG(status)) + "\n";
+        }
+        else if (WIFCONTINUED(status)) {
+            if (output_stderr.length() > 0)
+                output_stderr += '\n';
+            output_stderr += "continued\n";
         }
         else {
-            // Child process
-            if (dup2(fd_stdout[1], STDOUT_FILENO) < 0)
-                throw std::runtime_error("dup2() stdout: " + std::to_string(errno));
-            if (dup2(fd_stderr[1], STDERR_FILENO) < 0)
-                throw std::runtime_error("dup2() stderr: " + std::to_string(errno));
-
-            close(fd_stdout[0]);
-            close(fd_stdout[1]);
-            close(fd_stderr[0]);
-            close(fd_stderr[1]);
-
-            char * exec_args[1024];
-            unsigned int i = 0;
-            for (i = 0; i < command.size(); i++)
-               exec_args[i] = strdup(command[i].c_str());
-            exec_args[i + 1] = strdup("\0");
-            execv(command[0].c_str(), exec_args);
-            throw std::runtime_error("execv(): " + std::to_string(errno));
+            if (output_stderr.length() > 0)
+                output_stderr += '\n';
+            output_stderr += "unhandled exit status\n";
         }
+#endif
+        return exec_result_t {exit_code, std::move(output_stdout), std::move(output_stderr), false, signal};
+    }
+
+    // A forked child held back just before execve() until released, so that
+    // fork and pipe setup are kept out of the measured time.
+    class child {
+        private:
+            pid_t pid {-1};
+            int pidfd {-1};
+            int gate {-1};
+            int fd_stdin {-1};
+            output_pipes_t pipes;
+            pipe_pool *pool {nullptr};
+            const pipes::mapped_file *input {nullptr};
+            bool group {false};
+            bool registered {false};
+            bool retired {false}; // Pooled pipes possibly still written to
+
+            // Must happen before the pid is reaped and can be reused
+            void unregister() {
+                if (registered)
+                    groups::remove(pid);
+                registered = false;
+            }
+
+            // Signal the command, including everything it started, if it runs in its own group
+            void signal_all(const int signal_number) {
+                if (group && kill(-pid, signal_number) == 0)
+                    return;
+                kill(pid, signal_number);
+            }
+
+            // Only async-signal-safe calls from here on, exectime may be multithreaded
+            void fail(const char *what) {
+                const char *reason = strerror(errno);
+                if (::write(STDERR_FILENO, what, strlen(what)) >= 0 && ::write(STDERR_FILENO, ": ", 2) >= 0 && ::write(STDERR_FILENO, reason, strlen(reason)) >= 0) {
+                    if (::write(STDERR_FILENO, "\n", 1) < 0)
+                        _exit(127);
+                }
+                _exit(127);
+            }
+
+            void exec(const command_t &command) {
+                if (input) {
+                    if (dup2(fd_stdin, STDIN_FILENO) < 0)
+                        fail("dup2() stdin");
+                    signal(SIGPIPE, SIG_DFL);
+                }
+                if (dup2(pipes.stdout[1], STDOUT_FILENO) < 0)
+                    fail("dup2() stdout");
+                if (dup2(pipes.stderr[1], STDERR_FILENO) < 0)
+                    fail("dup2() stderr");
+                if (dup2(gate, 3) < 0)
+                    fail("dup2() gate");
+                if (group && setpgid(0, 0) != 0)
+                    fail("setpgid()");
+
+                // Drop every descriptor inherited from exectime, including
+                // pipes of a concurrently running sibling
+                close_from(4);
+
+                char go;
+                ssize_t count;
+                while ((count = ::read(3, &go, 1)) < 0 && errno == EINTR);
+                if (count != 1)
+                    _exit(127); // Abandoned without release
+                close(3);
+
+                execve(command.executable(), command.arguments(), command.environment());
+                fail(command.executable());
+            }
+        public:
+            // With process_group set the command runs in a process group of its
+            // own, so that a timeout terminates its descendants as well. Pooled
+            // children always do, the group tells whether their pipes are free.
+            child(const command_t &command, const pipes::mapped_file *input_file = nullptr, pipe_pool *output_pool = nullptr, const bool process_group = false) : pool(output_pool), input(input_file), group(process_group || output_pool) {
+                int fd_gate[2]; // [0]=read, [1]=write
+                if (pipe2(fd_gate, O_CLOEXEC) != 0)
+                    throw std::runtime_error("pipe() gate:" + std::to_string(errno));
+
+                int fd_input[2] {-1, -1}; // [0]=read, [1]=write
+                if (input && pipe2(fd_input, O_CLOEXEC) != 0)
+                    throw std::runtime_error("pipe() stdin:" + std::to_string(errno));
+
+                if (pool) {
+                    pipes = pool->acquire();
+                }
+                else {
+                    if (pipe2(pipes.stdout, O_CLOEXEC) != 0)
+                        throw std::runtime_error("pipe() stdout:" + std::to_string(errno));
+                    if (pipe2(pipes.stderr, O_CLOEXEC) != 0)
+                        throw std::runtime_error("pipe() stderr:" + std::to_string(errno));
+                }
+
+                pid = fork(); // TODO: use vfork() instead?
+                if (pid < 0) {
+                    int error = errno;
+                    for (int fd: {fd_gate[0], fd_gate[1], fd_input[0], fd_input[1]}) {
+                        if (fd >= 0)
+                            close(fd);
+                    }
+                    if (pool) {
+                        pool->release(pipes);
+                    }
+                    else {
+                        for (int fd: {pipes.stdout[0], pipes.stdout[1], pipes.stderr[0], pipes.stderr[1]})
+                            close(fd);
+                    }
+                    throw std::runtime_error("fork(): " + std::to_string(error));
+                }
+
+                if (pid == 0) {
+                    // Child process
+                    gate = fd_gate[0];
+                    fd_stdin = fd_input[0];
+                    exec(command);
+                }
+
+                // Parent process
+                close(fd_gate[0]);
+                gate = fd_gate[1];
+                if (group) {
+                    setpgid(pid, pid); // Also in the parent, avoids racing the child
+                    groups::add(pid);
+                    registered = true;
+                }
+
+                if (input) {
+                    close(fd_input[0]);
+                    fd_stdin = fd_input[1];
+                    fcntl(fd_stdin, F_SETFL, fcntl(fd_stdin, F_GETFL) | O_NONBLOCK);
+                    fcntl(fd_stdin, F_SETPIPE_SZ, 1 << 20); // Best effort, fewer wakeups for large inputs
+                }
+
+                pidfd = pidfd_open(pid);
+                if (pidfd < 0 && pool) {
+                    // Let the parked child exit and hand the pipes back before giving up
+                    int error = errno;
+                    close(gate);
+                    gate = -1;
+                    if (fd_stdin >= 0)
+                        close(fd_stdin);
+                    unregister();
+                    waitpid(pid, nullptr, 0);
+                    pool->release(pipes);
+                    throw std::runtime_error("pidfd_open(): " + std::string(strerror(error)));
+                }
+                if (!pool) {
+                    close(pipes.stdout[1]);
+                    close(pipes.stderr[1]);
+                    pipes.stdout[1] = -1;
+                    pipes.stderr[1] = -1;
+                }
+            }
+
+            child(const child &) = delete;
+            child &operator=(const child &) = delete;
+
+            ~child() {
+                unregister();
+                if (gate >= 0) {
+                    // Never released: let it exit without executing the command
+                    close(gate);
+                    gate = -1;
+                    waitpid(pid, nullptr, 0);
+                }
+                if (fd_stdin >= 0)
+                    close(fd_stdin);
+                if (pidfd >= 0)
+                    close(pidfd);
+                if (pool && !retired) {
+                    pool->release(pipes);
+                }
+                else {
+                    for (int fd: {pipes.stdout[0], pipes.stdout[1], pipes.stderr[0], pipes.stderr[1]}) {
+                        if (fd >= 0)
+                            close(fd);
+                    }
+                }
+            }
+
+            pid_t id() const {
+                return pid;
+            }
+
+            // Let the child execute the command
+            void release() {
+                while (::write(gate, "x", 1) < 0 && errno == EINTR);
+                close(gate);
+                gate = -1;
+            }
+
+            // Feed input and drain output until the child has completed. If
+            // input is given it is fed to the child's stdin while stdout and
+            // stderr are drained, so that neither side can block on a full pipe.
+            // Past the deadline the command gets SIGTERM, and SIGKILL if it is
+            // still running after the grace period.
+            exec_result_t wait(const deadline_t deadline = deadline_t::max(), const std::chrono::milliseconds grace = std::chrono::milliseconds(1000)) {
+                if (gate >= 0)
+                    release();
+
+                std::size_t input_offset {0};
+                if (input && input->size() == 0) {
+                    close(fd_stdin);
+                    fd_stdin = -1;
+                }
+
+                std::string output_stdout;
+                std::string output_stderr;
+                struct pollfd fds[4] {
+                    {pipes.stdout[0], POLLIN, 0},
+                    {pipes.stderr[0], POLLIN, 0},
+                    {fd_stdin, POLLOUT, 0},
+                    {pidfd, POLLIN, 0}
+                };
+                bool exited {false};
+                bool timed_out {false};
+                bool killed {false};
+                deadline_t alarm = deadline;
+                bool completed {false};
+                while (!completed) {
+                    int timeout = -1;
+                    if (alarm != deadline_t::max()) {
+                        auto remaining = std::chrono::ceil<std::chrono::milliseconds>(alarm - std::chrono::steady_clock::now()).count();
+                        timeout = static_cast<int>(std::max<decltype(remaining)>(0, std::min<decltype(remaining)>(remaining, 1 << 30)));
+                    }
+                    // Without a pidfd the exit is polled for once the pipes cannot tell
+                    if (pidfd < 0 && !exited && ((fds[0].fd < 0 && fds[1].fd < 0) || killed) && (timeout < 0 || timeout > 1))
+                        timeout = 1;
+
+                    int ready = poll(fds, 4, timeout);
+                    if (ready < 0) {
+                        if (errno == EINTR)
+                            continue;
+                        throw std::runtime_error("poll(): " + std::to_string(errno));
+                    }
+
+                    // Also once the command itself has exited, its group may still hold the pipes
+                    if (!killed && alarm != deadline_t::max() && std::chrono::steady_clock::now() >= alarm) {
+                        if (!timed_out) {
+                            timed_out = true;
+                            signal_all(SIGTERM);
+                            alarm = std::chrono::steady_clock::now() + grace;
+                        }
+                        else {
+                            killed = true;
+                            signal_all(SIGKILL);
+                            alarm = deadline_t::max();
+                        }
+                    }
+                    if (fds[0].revents && !pipes::read_available(fds[0].fd, output_stdout))
+                        fds[0].fd = -1;
+                    if (fds[1].revents && !pipes::read_available(fds[1].fd, output_stderr))
+                        fds[1].fd = -1;
+                    if (fds[2].revents) {
+                        ssize_t count = -1;
+                        if (!(fds[2].revents & (POLLERR | POLLHUP)))
+                            count = pipes::write_available(fds[2].fd, input->data() + input_offset, input->size() - input_offset);
+                        if (count > 0)
+                            input_offset += count;
+                        if (count < 0 || input_offset == input->size()) {
+                            close(fd_stdin);
+                            fd_stdin = -1;
+                            fds[2].fd = -1;
+                        }
+                    }
+                    if (fds[3].revents) {
+                        exited = true;
+                        fds[3].fd = -1;
+                    }
+                    else if (pidfd < 0 && !exited) {
+                        // Not reaped yet, the pid stays registered for signal forwarding
+                        siginfo_t info;
+                        info.si_pid = 0;
+                        exited = waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0 && info.si_pid == pid;
+                    }
+
+                    if (pool) {
+                        // Pooled pipes never reach end of file, collect what the exited child left behind
+                        if (exited) {
+                            for (std::string::size_type size = output_stdout.size(); pipes::read_available(fds[0].fd, output_stdout) && output_stdout.size() > size; size = output_stdout.size());
+                            for (std::string::size_type size = output_stderr.size(); pipes::read_available(fds[1].fd, output_stderr) && output_stderr.size() > size; size = output_stderr.size());
+                            completed = true;
+                        }
+                    }
+                    else {
+                        // Closed pipes alone do not mean completion, the command may
+                        // have redirected them and still be running past its deadline.
+                        // Descendants outside of the group may hold on to the pipes even after SIGKILL.
+                        completed = exited && ((fds[0].fd < 0 && fds[1].fd < 0 && fds[2].fd < 0) || killed);
+                    }
+                }
+
+                if (fd_stdin >= 0) {
+                    close(fd_stdin);
+                    fd_stdin = -1;
+                }
+
+                int status;
+                pid_t ws;
+                unregister();
+                while ((ws = waitpid(pid, &status, 0)) < 0 && errno == EINTR);
+                if (ws != pid)
+                    throw std::runtime_error("Failed to wait for pid " + std::to_string(pid));
+                // Processes the command left behind in its group may still write
+                if (pool && kill(-pid, 0) == 0)
+                    retired = true;
+                exec_result_t result = make_result(status, output_stdout, output_stderr);
+                result.timed_out = timed_out;
+                return result;
+            }
+    };
+
+    // Run command to completion, or until the deadline has passed
+    inline exec_result_t run(const command_t &command, const pipes::mapped_file *input = nullptr, const deadline_t deadline = deadline_t::max()) {
+        child process(command, input, nullptr, deadline != deadline_t::max());
+        return process.wait(deadline);
+    }
+
+    inline exec_result_t run(const std::vector<std::string> &command, const pipes::mapped_file *input = nullptr, const deadline_t deadline = deadline_t::max()) {
+        return run(command_t(command), input, deadline);
     }
 }
 
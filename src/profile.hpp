@@ -0,0 +1,459 @@
+#ifndef __PROFILE_HPP_INCLUDED__
+#define __PROFILE_HPP_INCLUDED__
+
+#include "pipes.hpp"
+
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+#include <unistd.h> // close(), read(), write(), syscall(), sysconf()
+#include <errno.h>
+#include <poll.h> // poll()
+#include <elf.h> // Elf64_Ehdr, Elf64_Shdr, Elf64_Phdr, Elf64_Sym
+#include <cxxabi.h> // abi::__cxa_demangle()
+#include <sys/mman.h> // mmap(), munmap()
+#include <sys/eventfd.h> // eventfd()
+#include <sys/syscall.h> // SYS_perf_event_open
+#include <linux/perf_event.h>
+
+// Sampling profiler for the measured command: user stacks are sampled with
+// perf_event_open() and walked by the kernel along frame pointers, so the
+// command needs -fno-omit-frame-pointer for complete stacks. The result is
+// written in the collapsed format ("comm;outer;...;inner count") consumed
+// by flamegraph.pl and difffolded.pl.
+namespace profile {
+    inline int perf_event_open(struct perf_event_attr *attr, const pid_t pid, const int cpu = -1) {
+        return static_cast<int>(syscall(SYS_perf_event_open, attr, pid, cpu, -1, PERF_FLAG_FD_CLOEXEC));
+    }
+
+    inline struct perf_event_attr attributes(const unsigned int frequency) {
+        struct perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_SOFTWARE;
+        attr.config = PERF_COUNT_SW_TASK_CLOCK;
+        attr.freq = 1;
+        attr.sample_freq = frequency;
+        attr.sample_type = PERF_SAMPLE_TID | PERF_SAMPLE_TIME | PERF_SAMPLE_CALLCHAIN;
+        attr.sample_id_all = 1;
+        attr.disabled = 1;
+        attr.enable_on_exec = 1;
+        attr.inherit = 1;
+        attr.mmap = 1;
+        attr.mmap2 = 1;
+        attr.comm = 1;
+        attr.comm_exec = 1;
+        attr.task = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.exclude_callchain_kernel = 1;
+        attr.watermark = 1;
+        return attr;
+    }
+
+    // Throw if sampling at the given frequency is not permitted on this host
+    inline void probe(const unsigned int frequency) {
+        struct perf_event_attr attr = attributes(frequency);
+        int fd = perf_event_open(&attr, 0);
+        if (fd < 0) {
+            int error = errno;
+            std::string hint = (error == EACCES || error == EPERM) ? ", see /proc/sys/kernel/perf_event_paranoid" : (error == EINVAL ? ", see /proc/sys/kernel/perf_event_max_sample_rate" : "");
+            throw std::runtime_error("perf_event_open(): " + std::string(std::strerror(error)) + hint);
+        }
+        close(fd);
+    }
+
+    // Function symbols of one ELF file, looked up by file offset
+    class symbols {
+        private:
+            struct segment_t {
+                std::uint64_t offset;
+                std::uint64_t size;
+                std::uint64_t address;
+            };
+
+            struct symbol_t {
+                std::uint64_t start;
+                std::uint64_t end;
+                std::string name;
+
+                bool operator<(const symbol_t &other) const {
+                    return start < other.start;
+                }
+            };
+
+            std::vector<segment_t> segments;
+            std::vector<symbol_t> functions;
+
+            static std::string demangle(const char *name) {
+                int status = 0;
+                char *demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+                if (status != 0 || !demangled)
+                    return name;
+                std::string result {demangled};
+                std::free(demangled);
+                return result;
+            }
+        public:
+            // Files which cannot be read or are no 64-bit ELF simply have no symbols
+            explicit symbols(const std::string &filename) {
+                std::unique_ptr<pipes::mapped_file> file;
+                try {
+                    file = std::make_unique<pipes::mapped_file>(filename);
+                }
+                catch (const std::exception &) {
+                    return;
+                }
+
+                const char *data = file->data();
+                const std::size_t size = file->size();
+                if (size < sizeof(Elf64_Ehdr) || std::memcmp(data, ELFMAG, SELFMAG) != 0 || data[EI_CLASS] != ELFCLASS64)
+                    return;
+                const Elf64_Ehdr *header = reinterpret_cast<const Elf64_Ehdr *>(data);
+
+                if (header->e_phoff + header->e_phnum * sizeof(Elf64_Phdr) <= size) {
+                    const Elf64_Phdr *programs = reinterpret_cast<const Elf64_Phdr *>(data + header->e_phoff);
+                    for (unsigned int index = 0; index < header->e_phnum; index++) {
+                        if (programs[index].p_type == PT_LOAD)
+                            segments.push_back(segment_t {programs[index].p_offset, programs[index].p_filesz, programs[index].p_vaddr});
+                    }
+                }
+
+                if (header->e_shoff + header->e_shnum * sizeof(Elf64_Shdr) > size)
+                    return;
+                const Elf64_Shdr *sections = reinterpret_cast<const Elf64_Shdr *>(data + header->e_shoff);
+
+                // The full symbol table if not stripped, the dynamic one otherwise
+                for (const Elf64_Word type: std::initializer_list<Elf64_Word> {SHT_SYMTAB, SHT_DYNSYM}) {
+                    for (unsigned int index = 0; index < header->e_shnum; index++) {
+                        const Elf64_Shdr &table = sections[index];
+                        if (table.sh_type != type || table.sh_link >= header->e_shnum || table.sh_offset + table.sh_size > size)
+                            continue;
+                        const Elf64_Shdr &strings = sections[table.sh_link];
+                        if (strings.sh_offset + strings.sh_size > size)
+                            continue;
+
+                        const Elf64_Sym *entries = reinterpret_cast<const Elf64_Sym *>(data + table.sh_offset);
+                        for (std::size_t entry = 0; entry < table.sh_size / sizeof(Elf64_Sym); entry++) {
+                            const Elf64_Sym &symbol = entries[entry];
+                            const unsigned char kind = ELF64_ST_TYPE(symbol.st_info);
+                            if ((kind != STT_FUNC && kind != STT_GNU_IFUNC) || symbol.st_shndx == SHN_UNDEF || symbol.st_size == 0 || symbol.st_name >= strings.sh_size)
+                                continue;
+                            const char *name = data + strings.sh_offset + symbol.st_name;
+                            functions.push_back(symbol_t {symbol.st_value, symbol.st_value + symbol.st_size, demangle(name)});
+                        }
+                    }
+                    if (functions.size() > 0)
+                        break;
+                }
+                std::sort(functions.begin(), functions.end());
+            }
+
+            // Name of the function at the given file offset, empty if unknown
+            std::string lookup(const std::uint64_t offset) const {
+                for (const auto &segment: segments) {
+                    if (offset < segment.offset || offset >= segment.offset + segment.size)
+                        continue;
+
+                    const std::uint64_t address = offset - segment.offset + segment.address;
+                    auto candidate = std::upper_bound(functions.begin(), functions.end(), symbol_t {address, address, ""});
+                    if (candidate == functions.begin())
+                        return "";
+                    --candidate;
+                    return (address < candidate->end) ? candidate->name : "";
+                }
+                return "";
+            }
+    };
+
+    // Raw perf records of one command execution, collected while it runs.
+    // Sampling starts when the child calls exec(), so the sampler must be
+    // created between fork and exec, i.e. before process::child::release().
+    // Inherited per-task events cannot be mapped, so there is one event and
+    // ring buffer per CPU, merged by timestamp when the records are replayed.
+    class sampler {
+        private:
+            static constexpr std::size_t data_pages {64};
+
+            struct ring_t {
+                int fd;
+                void *buffer;
+                std::vector<char> records;
+            };
+
+            std::vector<ring_t> rings;
+            int wakeup {-1};
+            std::size_t buffer_size {0};
+            std::size_t page_size {0};
+            std::thread reader;
+            std::atomic<bool> stopping {false};
+
+            // Copy all complete records from a ring buffer
+            void drain(ring_t &ring) {
+                struct perf_event_mmap_page *control = static_cast<struct perf_event_mmap_page *>(ring.buffer);
+                const char *data = static_cast<const char *>(ring.buffer) + page_size;
+                const std::size_t data_size = buffer_size - page_size;
+
+                const std::uint64_t head = __atomic_load_n(&control->data_head, __ATOMIC_ACQUIRE);
+                const std::uint64_t tail = control->data_tail;
+                if (head == tail)
+                    return;
+
+                // The unread part may wrap around the end of the buffer
+                const std::size_t offset = tail % data_size;
+                const std::size_t first = std::min<std::size_t>(head - tail, data_size - offset);
+                ring.records.insert(ring.records.end(), data + offset, data + offset + first);
+                if (first < head - tail)
+                    ring.records.insert(ring.records.end(), data, data + (head - tail - first));
+                __atomic_store_n(&control->data_tail, head, __ATOMIC_RELEASE);
+            }
+
+            void release() {
+                for (auto &ring: rings) {
+                    if (ring.buffer)
+                        munmap(ring.buffer, buffer_size);
+                    close(ring.fd);
+                }
+                rings.clear();
+                if (wakeup >= 0)
+                    close(wakeup);
+                wakeup = -1;
+            }
+        public:
+            sampler(const pid_t pid, const unsigned int frequency) {
+                page_size = sysconf(_SC_PAGESIZE);
+                buffer_size = (1 + data_pages) * page_size;
+
+                struct perf_event_attr attr = attributes(frequency);
+                attr.wakeup_watermark = (data_pages * page_size) / 4;
+                const long cpus = sysconf(_SC_NPROCESSORS_CONF);
+                for (int cpu = 0; cpu < cpus; cpu++) {
+                    int fd = perf_event_open(&attr, pid, cpu);
+                    if (fd < 0) {
+                        if (errno == ENODEV)
+                            continue; // Offline
+                        int error = errno;
+                        release();
+                        throw std::runtime_error("perf_event_open(): " + std::string(std::strerror(error)));
+                    }
+                    rings.push_back(ring_t {fd, nullptr, {}});
+
+                    rings.back().buffer = mmap(nullptr, buffer_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                    if (rings.back().buffer == MAP_FAILED) {
+                        int error = errno;
+                        rings.back().buffer = nullptr;
+                        release();
+                        throw std::runtime_error("mmap(): " + std::string(std::strerror(error)));
+                    }
+                }
+
+                wakeup = eventfd(0, EFD_CLOEXEC);
+                if (wakeup < 0) {
+                    int error = errno;
+                    release();
+                    throw std::runtime_error("eventfd(): " + std::string(std::strerror(error)));
+                }
+
+                // Keep the ring buffers from overflowing during long runs
+                reader = std::thread([this] {
+                    std::vector<struct pollfd> fds;
+                    for (const auto &ring: rings)
+                        fds.push_back(pollfd {ring.fd, POLLIN, 0});
+                    fds.push_back(pollfd {wakeup, POLLIN, 0});
+                    while (!stopping.load()) {
+                        if (poll(fds.data(), fds.size(), -1) < 0 && errno != EINTR)
+                            break;
+                        for (std::size_t index = 0; index < rings.size(); index++) {
+                            if (fds[index].revents & (POLLHUP | POLLERR))
+                                fds[index].fd = -1; // Command exited, drained on stop
+                            else if (fds[index].revents & POLLIN)
+                                drain(rings[index]);
+                        }
+                    }
+                });
+            }
+
+            sampler(const sampler &) = delete;
+            sampler &operator=(const sampler &) = delete;
+
+            ~sampler() {
+                stop();
+                release();
+            }
+
+            // Stop collecting, the command should have completed
+            void stop() {
+                if (!reader.joinable())
+                    return;
+                stopping.store(true);
+                std::uint64_t one = 1;
+                while (::write(wakeup, &one, sizeof(one)) < 0 && errno == EINTR);
+                reader.join();
+                for (auto &ring: rings)
+                    drain(ring);
+            }
+
+            // Records per CPU, each in the order they were written
+            std::vector<const std::vector<char> *> data() {
+                stop();
+                std::vector<const std::vector<char> *> result;
+                for (const auto &ring: rings)
+                    result.push_back(&ring.records);
+                return result;
+            }
+    };
+
+    // Stacks of all sampled executions of one command, folded and counted
+    class collapsed {
+        private:
+            struct mapping_t {
+                std::uint64_t start;
+                std::uint64_t end;
+                std::uint64_t offset;
+                std::string filename;
+            };
+
+            struct task_t {
+                std::string comm;
+                std::vector<mapping_t> mappings;
+            };
+
+            std::map<std::string, std::unique_ptr<symbols>> cache;
+            std::map<std::string, unsigned long> stacks;
+
+            std::string frame(const task_t &task, const std::uint64_t address) {
+                for (auto mapping = task.mappings.rbegin(); mapping != task.mappings.rend(); ++mapping) {
+                    if (address < mapping->start || address >= mapping->end)
+                        continue;
+                    if (mapping->filename.length() == 0 || mapping->filename[0] != '/')
+                        return "[" + (mapping->filename.length() > 0 ? mapping->filename : "anon") + "]";
+
+                    auto &table = cache[mapping->filename];
+                    if (!table)
+                        table = std::make_unique<symbols>(mapping->filename);
+                    const std::uint64_t offset = address - mapping->start + mapping->offset;
+                    std::string name = table->lookup(offset);
+                    if (name.length() > 0)
+                        return name;
+
+                    char hex[24];
+                    std::snprintf(hex, sizeof(hex), "+0x%llx", static_cast<unsigned long long>(offset));
+                    return mapping->filename.substr(mapping->filename.rfind('/') + 1) + hex;
+                }
+                return "[unknown]";
+            }
+        public:
+            unsigned long samples {0};
+            unsigned long lost {0};
+
+            // Replay the records of all CPUs in time order, so that every
+            // sample is resolved against the mappings its process had then
+            void add(sampler &source) {
+                struct record_t {
+                    std::uint64_t time;
+                    const char *data;
+                    struct perf_event_header header;
+                };
+
+                std::vector<record_t> records;
+                for (const auto *data: source.data()) {
+                    std::size_t offset = 0;
+                    while (offset + sizeof(struct perf_event_header) <= data->size()) {
+                        record_t record;
+                        std::memcpy(&record.header, data->data() + offset, sizeof(record.header));
+                        if (record.header.size < sizeof(record.header) + 16 || offset + record.header.size > data->size())
+                            break;
+                        record.data = data->data() + offset + sizeof(record.header);
+                        offset += record.header.size;
+
+                        // Samples start with pid, tid and time, all other records end with them
+                        const char *time = (record.header.type == PERF_RECORD_SAMPLE) ? record.data + 8 : record.data + record.header.size - sizeof(record.header) - 8;
+                        std::memcpy(&record.time, time, sizeof(record.time));
+                        records.push_back(record);
+                    }
+                }
+                std::stable_sort(records.begin(), records.end(), [] (const record_t &a, const record_t &b) {
+                    return a.time < b.time;
+                });
+
+                std::map<std::uint32_t, task_t> tasks;
+                for (const auto &record: records) {
+                    const char *body = record.data;
+                    const std::size_t size = record.header.size - sizeof(record.header);
+                    std::uint32_t ids[2];
+                    std::memcpy(ids, body, sizeof(ids));
+                    if (record.header.type == PERF_RECORD_MMAP2) {
+                        std::uint64_t range[3]; // addr, len, pgoff
+                        std::memcpy(range, body + 8, sizeof(range));
+                        const char *filename = body + 8 + sizeof(range) + 4 + 4 + 8 + 8 + 4 + 4;
+                        tasks[ids[0]].mappings.push_back(mapping_t {range[0], range[0] + range[1], range[2], std::string(filename, strnlen(filename, body + size - filename))});
+                    }
+                    else if (record.header.type == PERF_RECORD_COMM && ids[0] == ids[1]) {
+                        task_t &task = tasks[ids[0]];
+                        task.comm = std::string(body + 8, strnlen(body + 8, size - 8));
+                        if (record.header.misc & PERF_RECORD_MISC_COMM_EXEC)
+                            task.mappings.clear();
+                    }
+                    else if (record.header.type == PERF_RECORD_FORK) {
+                        // Forked processes inherit the mappings of their parent
+                        if (ids[0] != ids[1] && tasks.count(ids[1]) > 0 && tasks.count(ids[0]) == 0)
+                            tasks[ids[0]] = tasks[ids[1]];
+                    }
+                    else if (record.header.type == PERF_RECORD_LOST) {
+                        std::uint64_t counts[2]; // id, lost
+                        std::memcpy(counts, body, sizeof(counts));
+                        lost += counts[1];
+                    }
+                    else if (record.header.type == PERF_RECORD_SAMPLE) {
+                        std::uint64_t count;
+                        std::memcpy(&count, body + 16, sizeof(count));
+                        const char *addresses = body + 24;
+                        if (count > (size - 24) / sizeof(std::uint64_t))
+                            continue;
+
+                        const task_t &task = tasks[ids[0]];
+                        std::vector<std::string> frames;
+                        for (std::uint64_t index = 0; index < count; index++) {
+                            std::uint64_t address;
+                            std::memcpy(&address, addresses + index * sizeof(address), sizeof(address));
+                            if (address >= PERF_CONTEXT_MAX)
+                                continue; // Context marker
+                            // Callers are return addresses, look up the call instruction
+                            frames.push_back(frame(task, frames.size() > 0 ? address - 1 : address));
+                        }
+
+                        std::string stack = (task.comm.length() > 0) ? task.comm : std::to_string(ids[0]);
+                        for (auto name = frames.rbegin(); name != frames.rend(); ++name)
+                            stack += ";" + *name;
+                        stacks[stack]++;
+                        samples++;
+                    }
+                }
+            }
+
+            void write(const std::string &filename) const {
+                std::ofstream stream(filename);
+                if (!stream.is_open())
+                    throw std::runtime_error("Failed to open file for writing: " + filename);
+                for (const auto &stack: stacks)
+                    stream << stack.first << " " << stack.second << "\n";
+                stream.close();
+                if (stream.fail())
+                    throw std::runtime_error("Failed to write file: " + filename);
+            }
+    };
+}
+
+#endif //__PROFILE_HPP_INCLUDED__
@@ -0,0 +1,116 @@
+#ifndef __PROGRESS_HPP_INCLUDED__
+#define __PROGRESS_HPP_INCLUDED__
+
+#include "exectime.hpp"
+#include "console.hpp"
+#include "statistics.hpp"
+
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+namespace progress {
+    // Unicode block elements, lowest to highest
+    static const char *sparkline_levels[] = {"▁", "▂", "▃", "▄", "▅", "▆", "▇", "█"};
+
+    inline std::string format_seconds(const double seconds) {
+        std::ostringstream ss;
+        ss << std::fixed;
+        ss.precision(1);
+        if (seconds >= 3600.0)
+            ss << static_cast<unsigned long>(seconds / 3600.0) << "h" << static_cast<unsigned long>(seconds / 60.0) % 60 << "m";
+        else if (seconds >= 60.0)
+            ss << static_cast<unsigned long>(seconds / 60.0) << "m" << static_cast<unsigned long>(seconds) % 60 << "s";
+        else
+            ss << seconds << "s";
+        return ss.str();
+    }
+
+    inline std::string sparkline(const std::vector<unsigned long> &values, const unsigned int width) {
+        if (values.size() == 0 || width == 0)
+            return "";
+
+        auto first = values.end() - std::min<std::size_t>(values.size(), width);
+        auto bounds = std::minmax_element(first, values.end());
+        double span = *bounds.second - *bounds.first;
+
+        std::string result;
+        for (auto it = first; it != values.end(); ++it) {
+            unsigned int level = 0;
+            if (span > 0.0)
+                level = static_cast<unsigned int>((*it - *bounds.first) / span * 7.0 + 0.5);
+            result += sparkline_levels[level];
+        }
+        return result;
+    }
+
+    // In-place progress display on stderr. Samples are appended for every
+    // iteration while the terminal is only redrawn once per refresh interval,
+    // and always outside of the measured region.
+    class display {
+        private:
+            console::tty screen {STDERR_FILENO};
+            unsigned int iterations;
+            std::chrono::milliseconds interval;
+            std::chrono::steady_clock::time_point started;
+            std::chrono::steady_clock::time_point rendered;
+            std::vector<unsigned long> samples;
+            double sum {0.0};
+
+            void render() {
+                using namespace std::chrono;
+                const std::string prefix = PROGRAM_NAME ": ";
+                int width = screen.cols - 1;
+
+                double elapsed = duration_cast<duration<double>>(steady_clock::now() - started).count();
+                double eta = 0.0;
+                if (samples.size() > 0)
+                    eta = elapsed / samples.size() * (iterations - samples.size());
+
+                std::ostringstream status;
+                status << prefix << "iteration " << samples.size() << "/" << iterations
+                       << " (" << static_cast<unsigned int>(100.0 * samples.size() / iterations) << "%)"
+                       << "  elapsed " << format_seconds(elapsed) << "  ETA " << format_seconds(eta);
+                screen.write_line(0, status.str());
+
+                std::ostringstream running;
+                running << prefix;
+                if (samples.size() > 0) {
+                    running << "mean " << (sum / samples.size() / 1000.0) << "ms"
+                            << "  median " << (statistics::percentile(samples, 50.0) / 1000.0) << "ms"
+                            << "  p99 " << (statistics::percentile(samples, 99.0) / 1000.0) << "ms";
+                }
+                screen.write_line(1, running.str());
+
+                int spark_width = std::max(0, width - static_cast<int>(prefix.length()));
+                screen.write_line(2, prefix + sparkline(samples, spark_width));
+
+                screen.redraw();
+                rendered = steady_clock::now();
+            }
+        public:
+            display(const unsigned int total, const std::chrono::milliseconds refresh_interval = std::chrono::milliseconds(100))
+                    : iterations(total), interval(refresh_interval) {
+                started = std::chrono::steady_clock::now();
+                rendered = started;
+                samples.reserve(total);
+                render();
+            }
+
+            ~display() {
+                screen.clear();
+            }
+
+            void update(const unsigned long sample) {
+                samples.push_back(sample);
+                sum += sample;
+                if (samples.size() == iterations || std::chrono::steady_clock::now() - rendered >= interval)
+                    render();
+            }
+    };
+}
+
+#endif //__PROGRESS_HPP_INCLUDED__
@@ -0,0 +1,453 @@
+#ifndef __REMOTE_HPP_INCLUDED__
+#define __REMOTE_HPP_INCLUDED__
+
+#include "exectime.hpp"
+#include "process.hpp"
+
+#include <stdexcept>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <mutex>
+
+#include <unistd.h> // read(), write(), close(), unlink()
+#include <errno.h>
+#include <netdb.h> // getaddrinfo()
+#include <arpa/inet.h> // htonl(), ntohl()
+#include <sys/socket.h>
+#include <sys/time.h> // struct timeval
+#include <sys/un.h> // struct sockaddr_un
+#include <sys/stat.h> // lstat(), S_ISSOCK
+#include <netinet/in.h>
+#include <netinet/tcp.h> // TCP_NODELAY
+
+// Distributed runs: an agent executes iterations on request and streams the
+// raw samples back, a coordinator fans the iterations out over several agents.
+//
+// Every message is a frame: u8 type, u32 payload length, payload. Integers are
+// in network byte order, strings are prefixed with their u32 length.
+//
+// Agents execute any command they are sent. On TCP, where every local user
+// can connect even to loopback, they only serve with a shared token, which
+// every run request has to carry. Unix sockets are guarded by file permissions.
+//
+//     run     'R'  string token, u32 iterations, u32 argc, argc strings
+//     sample  'S'  u64 elapsed microseconds, i32 exit code or negated signal
+//     done    'D'  (empty)
+//     error   'E'  string
+//     alive   'A'  (empty), sent while a run waits for its turn or executes
+//
+// A peer that stays silent for longer than the timeout is given up on, so
+// neither an idle connection nor a stalled agent can block the other side.
+namespace remote {
+    enum frame_type : std::uint8_t {
+        frame_run = 'R',
+        frame_sample = 'S',
+        frame_done = 'D',
+        frame_error = 'E',
+        frame_alive = 'A'
+    };
+
+    constexpr std::chrono::seconds heartbeat_interval {1};
+    constexpr std::chrono::seconds timeout {10};
+
+    struct address_t {
+        bool is_unix {false};
+        std::string path {""};
+        std::string host {""};
+        std::string port {""};
+    };
+
+    struct sample_t {
+        std::uint64_t elapsed;
+        std::int32_t exit_code; // Negated signal number if killed
+
+        std::string outcome() const {
+            return (exit_code < 0) ? process::classify(-1, -exit_code) : process::classify(exit_code, 0);
+        }
+    };
+
+    struct host_result_t {
+        std::string name;
+        std::vector<sample_t> samples;
+        std::string error {""};
+    };
+
+    // "unix:<path>" or "[<host>]:<port>". An empty host means all interfaces
+    // when listening and loopback when connecting.
+    inline address_t parse_address(const std::string &address) {
+        address_t result;
+        if (address.compare(0, 5, "unix:") == 0) {
+            result.is_unix = true;
+            result.path = address.substr(5);
+            if (result.path.length() == 0 || result.path.length() >= sizeof(sockaddr_un::sun_path))
+                throw std::runtime_error("Invalid unix socket path: \"" + address + "\"");
+            return result;
+        }
+
+        std::string::size_type offset_colon = address.rfind(':');
+        if (offset_colon == std::string::npos || offset_colon == address.length() - 1)
+            throw std::runtime_error("Address has no port: \"" + address + "\"");
+        result.host = address.substr(0, offset_colon);
+        result.port = address.substr(offset_colon + 1);
+        if (result.host.length() > 1 && result.host.front() == '[' && result.host.back() == ']')
+            result.host = result.host.substr(1, result.host.length() - 2);
+        return result;
+    }
+
+    // Let blocking reads, writes and connects fail with EAGAIN after the timeout
+    inline void set_timeout(const int fd) {
+        struct timeval limit {timeout.count(), 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &limit, sizeof(limit));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &limit, sizeof(limit));
+    }
+
+    inline int open_socket(const address_t &address, const bool listening) {
+        if (address.is_unix) {
+            int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd < 0)
+                throw std::runtime_error("socket(): " + std::to_string(errno));
+
+            struct sockaddr_un name;
+            std::memset(&name, 0, sizeof(name));
+            name.sun_family = AF_UNIX;
+            std::strncpy(name.sun_path, address.path.c_str(), sizeof(name.sun_path) - 1);
+
+            if (listening) {
+                // Replace a stale socket of an earlier agent, but nothing else
+                struct stat info;
+                if (lstat(address.path.c_str(), &info) == 0) {
+                    if (!S_ISSOCK(info.st_mode)) {
+                        close(fd);
+                        throw std::runtime_error("Refusing to replace " + address.path + ": exists and is no socket");
+                    }
+                    unlink(address.path.c_str());
+                }
+                if (bind(fd, reinterpret_cast<struct sockaddr *>(&name), sizeof(name)) != 0 || listen(fd, 4) != 0) {
+                    int error = errno;
+                    close(fd);
+                    throw std::runtime_error("Failed to listen on " + address.path + ": " + std::strerror(error));
+                }
+            }
+            else {
+                set_timeout(fd);
+                if (connect(fd, reinterpret_cast<struct sockaddr *>(&name), sizeof(name)) != 0) {
+                    int error = errno;
+                    close(fd);
+                    throw std::runtime_error("Failed to connect to " + address.path + ": " + std::strerror(error));
+                }
+            }
+            return fd;
+        }
+
+        struct addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        const char *host = address.host.length() > 0 ? address.host.c_str() : (listening ? nullptr : "localhost");
+        if (!host)
+            hints.ai_flags = AI_PASSIVE;
+        struct addrinfo *candidates = nullptr;
+        int status = getaddrinfo(host, address.port.c_str(), &hints, &candidates);
+        if (status != 0)
+            throw std::runtime_error("Failed to resolve " + address.host + ": " + gai_strerror(status));
+
+        int fd = -1;
+        int error = 0;
+        for (struct addrinfo *candidate = candidates; candidate && fd < 0; candidate = candidate->ai_next) {
+            fd = socket(candidate->ai_family, candidate->ai_socktype | SOCK_CLOEXEC, candidate->ai_protocol);
+            if (fd < 0)
+                continue;
+
+            int enable = 1;
+            bool ok;
+            if (listening) {
+                setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+                ok = bind(fd, candidate->ai_addr, candidate->ai_addrlen) == 0 && listen(fd, 4) == 0;
+            }
+            else {
+                set_timeout(fd);
+                ok = connect(fd, candidate->ai_addr, candidate->ai_addrlen) == 0;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+            }
+            if (!ok) {
+                error = errno;
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(candidates);
+
+        if (fd < 0)
+            throw std::runtime_error("Failed to " + std::string(listening ? "listen on " : "connect to ") + address.host + ":" + address.port + ": " + std::strerror(error));
+        return fd;
+    }
+
+    // Compare without leaking the length of the matching prefix through timing
+    inline bool same_token(const std::string &expected, const std::string &actual) {
+        unsigned char difference = expected.length() == actual.length() ? 0 : 1;
+        for (std::size_t index = 0; index < actual.length(); index++)
+            difference |= actual[index] ^ expected[index % std::max<std::size_t>(1, expected.length())];
+        return difference == 0;
+    }
+
+    inline void write_all(const int fd, const std::string &data) {
+        std::string::size_type offset = 0;
+        while (offset < data.length()) {
+            ssize_t count = send(fd, data.data() + offset, data.length() - offset, MSG_NOSIGNAL);
+            if (count < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    throw std::runtime_error("Timed out sending to the peer");
+                throw std::runtime_error("send(): " + std::string(std::strerror(errno)));
+            }
+            offset += count;
+        }
+    }
+
+    // Returns false if the connection was closed before any byte was read
+    inline bool read_all(const int fd, void *data, const std::size_t size) {
+        std::size_t offset = 0;
+        while (offset < size) {
+            ssize_t count = read(fd, static_cast<char *>(data) + offset, size - offset);
+            if (count < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    throw std::runtime_error("Timed out waiting for the peer");
+                throw std::runtime_error("read(): " + std::string(std::strerror(errno)));
+            }
+            if (count == 0) {
+                if (offset == 0)
+                    return false;
+                throw std::runtime_error("Connection closed within a frame");
+            }
+            offset += count;
+        }
+        return true;
+    }
+
+    class frame_writer {
+        private:
+            std::string payload;
+        public:
+            void put_u32(const std::uint32_t value) {
+                std::uint32_t network = htonl(value);
+                payload.append(reinterpret_cast<const char *>(&network), sizeof(network));
+            }
+
+            void put_u64(const std::uint64_t value) {
+                put_u32(static_cast<std::uint32_t>(value >> 32));
+                put_u32(static_cast<std::uint32_t>(value));
+            }
+
+            void put_string(const std::string &value) {
+                put_u32(value.length());
+                payload += value;
+            }
+
+            std::string frame(const frame_type type) const {
+                frame_writer header;
+                header.payload += static_cast<char>(type);
+                header.put_u32(payload.length());
+                return header.payload + payload;
+            }
+    };
+
+    class frame_reader {
+        private:
+            std::string payload;
+            std::string::size_type offset {0};
+
+            const char *take(const std::size_t size) {
+                if (offset + size > payload.length())
+                    throw std::runtime_error("Truncated frame");
+                const char *data = payload.data() + offset;
+                offset += size;
+                return data;
+            }
+        public:
+            frame_type type;
+
+            // Returns false on a cleanly closed connection
+            bool receive(const int fd) {
+                char header[5];
+                if (!read_all(fd, header, sizeof(header)))
+                    return false;
+                type = static_cast<frame_type>(header[0]);
+                std::uint32_t length;
+                std::memcpy(&length, header + 1, sizeof(length));
+                length = ntohl(length);
+                if (length > (64u << 20))
+                    throw std::runtime_error("Frame too large: " + std::to_string(length));
+                payload.resize(length);
+                offset = 0;
+                if (length > 0 && !read_all(fd, &payload[0], length))
+                    throw std::runtime_error("Connection closed within a frame");
+                return true;
+            }
+
+            std::uint32_t get_u32() {
+                std::uint32_t network;
+                std::memcpy(&network, take(sizeof(network)), sizeof(network));
+                return ntohl(network);
+            }
+
+            std::uint64_t get_u64() {
+                std::uint64_t high = get_u32();
+                return (high << 32) | get_u32();
+            }
+
+            std::string get_string() {
+                std::uint32_t length = get_u32();
+                return std::string(take(length), length);
+            }
+    };
+
+    // Execute one run request on an accepted connection, once no other run
+    // holds the host
+    inline void handle(const int fd, const std::string &token, std::timed_mutex &host) {
+        set_timeout(fd);
+        frame_reader request;
+        if (!request.receive(fd))
+            return;
+        if (request.type != frame_run)
+            throw std::runtime_error("Unexpected frame type: " + std::to_string(request.type));
+
+        if (!same_token(token, request.get_string())) {
+            frame_writer error;
+            error.put_string("Invalid token");
+            write_all(fd, error.frame(frame_error));
+            throw std::runtime_error("Rejected run request with an invalid token");
+        }
+
+        std::uint32_t iterations = request.get_u32();
+        std::vector<std::string> command(request.get_u32());
+        for (auto &arg: command)
+            arg = request.get_string();
+
+        const std::string alive = frame_writer().frame(frame_alive);
+        std::unique_lock<std::timed_mutex> turn(host, std::defer_lock);
+        while (!turn.try_lock_for(heartbeat_interval))
+            write_all(fd, alive);
+
+        try {
+            const process::command_t prepared(command);
+            for (std::uint32_t iteration = 0; iteration < iterations; iteration++) {
+                std::chrono::high_resolution_clock::duration elapsed;
+                std::future<process::exec_result_t> future = std::async(std::launch::async, [&] {
+                    auto begin = std::chrono::high_resolution_clock::now();
+                    process::exec_result_t outcome = process::run(prepared);
+                    elapsed = std::chrono::high_resolution_clock::now() - begin;
+                    return outcome;
+                });
+                while (future.wait_for(heartbeat_interval) == std::future_status::timeout)
+                    write_all(fd, alive);
+                process::exec_result_t result = future.get();
+
+                frame_writer sample;
+                sample.put_u64(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+                sample.put_u32(static_cast<std::uint32_t>(result.signal > 0 ? -result.signal : result.exit_code));
+                write_all(fd, sample.frame(frame_sample));
+            }
+        }
+        catch (const std::exception &e) {
+            frame_writer error;
+            error.put_string(e.what());
+            write_all(fd, error.frame(frame_error));
+            return;
+        }
+        write_all(fd, frame_writer().frame(frame_done));
+    }
+
+    // Serve every connection on a thread of its own but execute one run at a
+    // time, so that runs of different coordinators never compete for the
+    // host. Does not return.
+    [[noreturn]] inline void serve(const address_t &address, const std::string &token, std::ostream &log) {
+        if (token.length() == 0 && !address.is_unix)
+            throw std::runtime_error("Refusing to execute commands for anyone who connects to " + (address.host.length() > 0 ? address.host : "all interfaces") + ":" + address.port + ", a shared token is required (--token-file)");
+        int listener = open_socket(address, true);
+        static std::timed_mutex host;
+        static std::mutex logging;
+        while (true) {
+            int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                throw std::runtime_error("accept(): " + std::string(std::strerror(errno)));
+            }
+            std::thread([fd, &token, &log] {
+                try {
+                    handle(fd, token, host);
+                }
+                catch (const std::exception &e) {
+                    std::lock_guard<std::mutex> guard(logging);
+                    log << PROGRAM_NAME << ": agent: " << e.what() << std::endl;
+                }
+                close(fd);
+            }).detach();
+        }
+    }
+
+    // Split the iterations evenly over the hosts and collect their samples concurrently
+    inline std::vector<host_result_t> coordinate(const std::vector<std::string> &hosts, const std::vector<std::string> &command, const unsigned int iterations, const std::string &token) {
+        std::vector<host_result_t> results(hosts.size());
+        std::vector<std::thread> workers;
+        for (std::size_t index = 0; index < hosts.size(); index++) {
+            results[index].name = hosts[index];
+            unsigned int share = iterations / hosts.size() + (index < iterations % hosts.size() ? 1 : 0);
+            workers.emplace_back([&command, &token, share] (host_result_t &result) {
+                int fd = -1;
+                try {
+                    fd = open_socket(parse_address(result.name), false);
+
+                    frame_writer run;
+                    run.put_string(token);
+                    run.put_u32(share);
+                    run.put_u32(command.size());
+                    for (const auto &arg: command)
+                        run.put_string(arg);
+                    write_all(fd, run.frame(frame_run));
+
+                    result.samples.reserve(share);
+                    frame_reader response;
+                    while (true) {
+                        if (!response.receive(fd))
+                            throw std::runtime_error("Connection closed by agent");
+                        if (response.type == frame_done)
+                            break;
+                        if (response.type == frame_alive)
+                            continue;
+                        if (response.type == frame_error)
+                            throw std::runtime_error(response.get_string());
+                        if (response.type != frame_sample)
+                            throw std::runtime_error("Unexpected frame type: " + std::to_string(response.type));
+
+                        sample_t sample;
+                        sample.elapsed = response.get_u64();
+                        sample.exit_code = static_cast<std::int32_t>(response.get_u32());
+                        result.samples.push_back(sample);
+                    }
+                }
+                catch (const std::exception &e) {
+                    result.error = e.what();
+                }
+                if (fd >= 0)
+                    close(fd);
+            }, std::ref(results[index]));
+        }
+
+        for (auto &worker: workers)
+            worker.join();
+        return results;
+    }
+}
+
+#endif //__REMOTE_HPP_INCLUDED__
@@ -0,0 +1,64 @@
+#ifndef __REPORT_HPP_INCLUDED__
+#define __REPORT_HPP_INCLUDED__
+
+#include "statistics.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <functional>
+
+namespace report {
+    // Print the statistical summary of a sample set. Values are given in their
+    // raw unit and divided by scale for display in the given unit.
+    template<typename T>
+    statistics::statistics_t<T> summary(std::ostream &stream, const std::string &prefix, const std::vector<T> &values, const double scale, const std::string &unit) {
+        std::function<T (const T &)> selector = [] (const T &value) { return value; };
+        statistics::statistics_t<T> s = statistics::calculate(values, selector);
+        if (s.sample_size == 0)
+            return s;
+
+        unsigned int standard_deviation1 {0};
+        unsigned int standard_deviation2 {0};
+        unsigned int standard_deviation3 {0};
+        for (const auto &value: values) {
+            if (value >= std::max(0.0, s.average - s.standard_deviation) && value <= (s.average + s.standard_deviation))
+                standard_deviation1++;
+            if (value >= std::max(0.0, s.average - 2 * s.standard_deviation) && value <= (s.average + 2 * s.standard_deviation))
+                standard_deviation2++;
+            if (value >= std::max(0.0, s.average - 3 * s.standard_deviation) && value <= (s.average + 3 * s.standard_deviation))
+                standard_deviation3++;
+        }
+
+        //stream << prefix << "minimum..........................." << (s.minimum / scale) << unit << std::endl;
+        //stream << prefix << "maximum..........................." << (s.maximum / scale) << unit << std::endl;
+        stream << prefix << "range............................." << ((s.maximum - s.minimum) / scale) << unit << " (" << (s.minimum / scale) << "-" << (s.maximum / scale) << unit << ")" << std::endl;
+        stream << prefix << "average/mean......................" << (s.average / scale) << unit << std::endl;
+        stream << prefix << "median............................" << (s.median / scale) << unit << std::endl;
+        //stream << prefix << "variance.........................." << (s.variance / scale) << std::endl;
+        stream << prefix << "std. deviation...................." << (s.standard_deviation / scale) << unit << " (" << ((s.average - s.standard_deviation) / scale) << "-" << ((s.average + s.standard_deviation) / scale) << unit << ")" << std::endl;
+        stream << prefix << "norm. distr. mean±1σ (68.27%)....." << ((static_cast<double>(standard_deviation1) / s.sample_size) * 100.0) << "% (" << standard_deviation1 << "/" << s.sample_size << ")" << std::endl;
+        stream << prefix << "             mean±2σ (95.45%)....." << ((static_cast<double>(standard_deviation2) / s.sample_size) * 100.0) << "% (" << standard_deviation2 << "/" << s.sample_size << ")" << std::endl;
+        stream << prefix << "             mean±3σ (99.73%)....." << ((static_cast<double>(standard_deviation3) / s.sample_size) * 100.0) << "% (" << standard_deviation3 << "/" << s.sample_size << ")" << std::endl;
+        stream << prefix << "std. error........................" << s.standard_error << " (relative: " << s.relative_standard_error << "%)" << std::endl;
+        return s;
+    }
+
+    // One line summary of a subset, e.g. a single host or command
+    template<typename T>
+    statistics::statistics_t<T> brief(std::ostream &stream, const std::string &prefix, const std::string &label, const std::vector<T> &values, const double scale, const std::string &unit) {
+        std::function<T (const T &)> selector = [] (const T &value) { return value; };
+        statistics::statistics_t<T> s = statistics::calculate(values, selector);
+
+        std::string dots(label.length() < 31 ? 34 - label.length() : 3, '.');
+        stream << prefix << label << dots;
+        if (s.sample_size == 0) {
+            stream << "no samples" << std::endl;
+            return s;
+        }
+        stream << (s.average / scale) << unit << " ±" << (s.standard_deviation / scale) << unit << ", median " << (s.median / scale) << unit << " (" << s.sample_size << " samples)" << std::endl;
+        return s;
+    }
+}
+
+#endif //__REPORT_HPP_INCLUDED__
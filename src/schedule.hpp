@@ -0,0 +1,81 @@
+#ifndef __SCHEDULE_HPP_INCLUDED__
+#define __SCHEDULE_HPP_INCLUDED__
+
+#include "statistics.hpp"
+
+#include <vector>
+#include <random>
+#include <algorithm>
+
+namespace schedule {
+    // Execution order of rounds in which every command runs once, shuffled
+    // per round so that no command is systematically first or last
+    template<typename TGenerator>
+    std::vector<std::size_t> interleave(const std::size_t commands, const unsigned int rounds, TGenerator &generator) {
+        std::vector<std::size_t> round(commands);
+        for (std::size_t index = 0; index < commands; index++)
+            round[index] = index;
+
+        std::vector<std::size_t> order;
+        order.reserve(commands * rounds);
+        for (unsigned int r = 0; r < rounds; r++) {
+            std::shuffle(round.begin(), round.end(), generator);
+            order.insert(order.end(), round.begin(), round.end());
+        }
+        return order;
+    }
+
+    // Relative speed of the host per round, estimated from a control command
+    // run once every round: the moving median of the control around a round
+    // divided by the overall median. Dividing a sample by the factor of its
+    // round removes drift such as thermal throttling or background load. The
+    // control should be a stable, CPU bound workload or its noise is added.
+    template<typename TValue>
+    std::vector<double> drift(const std::vector<TValue> &control) {
+        std::vector<double> factors(control.size(), 1.0);
+        if (control.size() < 3)
+            return factors;
+
+        const double overall = statistics::percentile(control, 50.0);
+        if (overall <= 0.0)
+            return factors;
+
+        const std::size_t half_window = std::max<std::size_t>(2, std::min<std::size_t>(10, control.size() / 10));
+        for (std::size_t r = 0; r < control.size(); r++) {
+            std::size_t first = (r > half_window) ? r - half_window : 0;
+            std::size_t last = std::min(control.size(), r + half_window + 1);
+            std::vector<TValue> window(control.begin() + first, control.begin() + last);
+            factors[r] = statistics::percentile(window, 50.0) / overall;
+        }
+        return factors;
+    }
+
+    // Drift from the valid rounds of the control only, such as those that
+    // succeeded. Every other round takes the factor of the closest valid one.
+    template<typename TValue>
+    std::vector<double> drift(const std::vector<TValue> &control, const std::vector<bool> &valid) {
+        std::vector<TValue> samples;
+        std::vector<std::size_t> rounds;
+        for (std::size_t r = 0; r < control.size() && r < valid.size(); r++) {
+            if (valid[r]) {
+                samples.push_back(control[r]);
+                rounds.push_back(r);
+            }
+        }
+
+        std::vector<double> factors(control.size(), 1.0);
+        const std::vector<double> measured = drift(samples);
+        std::size_t nearest = 0;
+        for (std::size_t r = 0; r < control.size() && measured.size() > 0; r++) {
+            while (nearest + 1 < rounds.size() && rounds[nearest + 1] <= r)
+                nearest++;
+            std::size_t closest = nearest;
+            if (nearest + 1 < rounds.size() && rounds[nearest] < r && rounds[nearest + 1] - r < r - rounds[nearest])
+                closest = nearest + 1;
+            factors[r] = measured[closest];
+        }
+        return factors;
+    }
+}
+
+#endif //__SCHEDULE_HPP_INCLUDED__
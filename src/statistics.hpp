@@ -67,6 +67,18 @@ namespace statistics {
 
         return s;
     }
+
+    // Nearest-rank percentile (0-100) in linear time; the values are taken by copy and reordered.
+    template<typename TValue>
+    TValue percentile(std::vector<TValue> values, const double p) {
+        if (values.size() == 0)
+            return TValue {0};
+
+        std::size_t rank = static_cast<std::size_t>(std::ceil(p / 100.0 * values.size()));
+        std::size_t index = std::min(values.size() - 1, rank > 0 ? rank - 1 : 0);
+        std::nth_element(values.begin(), values.begin() + index, values.end());
+        return values[index];
+    }
 }
 
 #endif //__STATISTICS_HPP_INCLUDED__